@@ -10,12 +10,68 @@
 #define ACCEL_CS_GPIO_PORT SPI1_CS_GPIO_PORT
 //SPI1_CS_GPIO_PORT from main.h
 
+// Interrupt driven reads
+// INT1 (the only INT pin wired, PD15) starts a non-blocking SPI3 DMA read from
+// the EXTI handler. With ACCEL_USE_FIFO set, the ADXL362 FIFO runs in stream
+// mode and INT1 is its watermark, raised once ACCEL_FIFO_WATERMARK_SETS X/Y/Z
+// sets are queued; the whole FIFO is then read in one burst. Otherwise INT1 is
+// DATA_READY and each interrupt reads one X/Y/Z set.
+// Either way the DMA completion pushes the sets into a single producer /
+// single consumer ring that the frame loop empties with accel_ring_average()
+// without touching the bus.
+#define ACCEL_USE_FIFO 1
+#define ACCEL_FIFO_WATERMARK_SETS 5   // 50 ms of samples at 100 Hz
+#define ACCEL_FIFO_MAX_SETS 32        // largest batch drained at once
+#define ACCEL_STALL_MS 200            // re-arm from the main loop if nothing arrives
+#define ACCEL_READ_RETRIES 2          // failed reads retried at once, in a row
+#define ACCEL_RING_SIZE 64            // X/Y/Z sets, power of two
+#define ACCEL_ODR_HZ 100              // FILTER_CTL output data rate
+
+// Motion gate
+// Inactivity is referenced to the reading when it starts, so slow drift does
+// not count as motion. Activity (100 mg) and inactivity run linked in loop
+// mode; STATUS.AWAKE says which was seen last and comes back with every read.
+#define ACCEL_INACT_THRESH_MG 50      // 1 mg per LSB at +-2 g, 11 bits
+#define ACCEL_INACT_TIME_SAMPLES 200  // 2 s at 100 Hz, 16 bits
+#define ACCEL_STATUS_AWAKE 0x40
+
+#if ACCEL_USE_FIFO
+#define ACCEL_INT1_DATA_MAP 0x04      // FIFO_WATERMARK
+#else
+#define ACCEL_INT1_DATA_MAP 0x01      // DATA_READY
+#endif
+
+#if ACCEL_FIFO_WATERMARK_SETS * 3 > 511 || ACCEL_FIFO_MAX_SETS < ACCEL_FIFO_WATERMARK_SETS
+#error "bad ADXL362 FIFO configuration"
+#endif
+#if (ACCEL_RING_SIZE & (ACCEL_RING_SIZE - 1)) || ACCEL_RING_SIZE < ACCEL_FIFO_MAX_SETS
+#error "ACCEL_RING_SIZE must be a power of two holding a full FIFO batch"
+#endif
+
+typedef struct
+{
+	int16_t x, y, z;
+	uint32_t stamp; // cycle count it was measured at, when M2P_ENABLE (m2p.h)
+} Accel_Sample_t;
+
+// Called from the SPI3 DMA completion with the bytes clocked in after the
+// command, or with status != HAL_OK and no data if the transfer failed.
+typedef void (*accel_read_cb)(HAL_StatusTypeDef status, const uint8_t *data, uint16_t len);
+
 // VDD pins on STM32F446 are 3.3V, so should be compatible with accelerometer.
 HAL_StatusTypeDef accel_init(void);
 int8_t accel_read (int8_t reg);
 HAL_StatusTypeDef accel_write(uint8_t reg, uint8_t val);
 HAL_StatusTypeDef accel_poll(int16_t *read_buff);
 
+HAL_StatusTypeDef accel_read_async(const uint8_t *cmd, uint8_t cmd_len, uint16_t len, accel_read_cb done);
+void accel_int1_handler(void);
+uint8_t accel_ring_pop(Accel_Sample_t *sample);
+uint16_t accel_ring_average(int16_t *read_buff);
+
+uint8_t accel_awake(void);
+HAL_StatusTypeDef accel_wake_arm(void);
+
 #endif
 
 /* Roadmap
@@ -0,0 +1,63 @@
+#ifndef __DLOG_H
+#define __DLOG_H
+
+#include "main.h"
+#include <stdarg.h>
+#include <string.h>
+
+// Deferred logging over USART3
+// DLOG(id, args...) copies a format ID and the raw arguments into a RAM ring
+// instead of formatting and sending text; USART3 DMA drains the ring in the
+// background and tools/dlog_decode.py formats the records on the host. A call
+// costs a few dozen cycles and never waits on the UART.
+//
+// Records on the wire:
+//   DLOG_SYNC, id, nargs, nargs * 4 bytes little endian   format from dlog_formats.h
+//   DLOG_SYNC, DLOG_ID_TEXT, len, len bytes                preformatted text (print_msg)
+//   DLOG_SYNC, DLOG_ID_DROPPED, 1, 4 bytes                 records lost to a full ring
+// dlog_raw() bytes (telemetry packets) are interleaved between records.
+//
+// With DLOG_ENABLE 0, print_msg() goes back to blocking HAL_UART_Transmit and
+// DLOG() compiles to nothing.
+#define DLOG_ENABLE 1
+#define DLOG_RING_SIZE 1024   // bytes, power of two
+#define DLOG_MAX_ARGS 8
+#define DLOG_SYNC 0xD1
+#define DLOG_ID_TEXT 0xFF
+#define DLOG_ID_DROPPED 0xFE
+
+#if DLOG_RING_SIZE & (DLOG_RING_SIZE - 1)
+#error "DLOG_RING_SIZE must be a power of two"
+#endif
+
+enum {
+#define DLOG_FORMAT(id, fmt) id,
+#include "dlog_formats.h"
+#undef DLOG_FORMAT
+  DLOG_FORMAT_COUNT
+};
+
+// Float argument, sent as its IEEE 754 bits
+static inline uint32_t DLOG_F(float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+// Counts 1 to 9 arguments (the ID plus up to DLOG_MAX_ARGS)
+#define DLOG_NARGS(...) DLOG_NARGS_(__VA_ARGS__, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, _9, n, ...) n
+
+#if DLOG_ENABLE
+#define DLOG(...) dlog_write(DLOG_NARGS(__VA_ARGS__) - 1, __VA_ARGS__)
+#else
+#define DLOG(...) ((void)0)
+#endif
+
+void dlog_write(uint8_t nargs, uint8_t id, ...);
+void dlog_text(const char *text);
+void dlog_raw(const uint8_t *data, uint16_t len);
+void dlog_flush(void);
+
+#endif
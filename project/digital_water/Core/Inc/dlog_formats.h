@@ -0,0 +1,21 @@
+// Deferred log format strings, one DLOG_FORMAT(id, format) per line.
+// The record carries only the ID and raw 32-bit arguments; the host decoder
+// (tools/dlog_decode.py) reads this file to format them, and the ID is the
+// position in the list, so only append. Arguments may be integers (%d %u %x
+// %c) or floats passed through DLOG_F() (%f); %s is not supported.
+// No include guard: dlog.h includes this with DLOG_FORMAT defined.
+
+DLOG_FORMAT(DLOG_ACCEL_DEVICE_ID, "Read a value of: 0x%x\n")
+DLOG_FORMAT(DLOG_ACCEL_REG01, "Contents of register 0x01 is 0x%x\n")
+DLOG_FORMAT(DLOG_ACCEL_WRITE, "Writing 0x%x into register 0x%x\n")
+DLOG_FORMAT(DLOG_ACCEL_WRITE_FAIL, "Write no good\n")
+DLOG_FORMAT(DLOG_ACCEL_READING, "Reading\n")
+DLOG_FORMAT(DLOG_ACCEL_XFER_HEADER, "tx_buff       rx_buff\n")
+DLOG_FORMAT(DLOG_ACCEL_XFER_BYTE, "0x%x       0x%x\n")
+DLOG_FORMAT(DLOG_ACCEL_READ, "Read on reg 0x%x returns value 0x%x\n")
+DLOG_FORMAT(DLOG_SAMPLE, "X: %d\nY: %d\nZ: %d\nGravity X: %f\nGravity Y: %f\n")
+DLOG_FORMAT(DLOG_ORIENT_CYCLES, "Orientation cycles: update %u, gravity %u\n")
+DLOG_FORMAT(DLOG_PHYSICS_TICKS, "Physics ticks: %u late, %u dropped\n")
+DLOG_FORMAT(DLOG_GOV_LEVEL, "Governor level %u: worst frame %u of %u cycles\n")
+DLOG_FORMAT(DLOG_STACK, "Stack: %u of %u bytes used\n")
+DLOG_FORMAT(DLOG_DUMPS_CUT, "Dumps cut short: %u\n")
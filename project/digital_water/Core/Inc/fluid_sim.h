@@ -3,6 +3,7 @@
 
 #include "main.h"
 #include "physics.h"
+#include "water_palette.h"
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -28,18 +29,37 @@
 #define SIM_WATER 2
 #define SIM_OBSTACLE 3
 
-#define SIM_PHYSICS_FPS 6
-#define SIM_RENDER_FPS 6
+// Physics steps at a fixed SIM_PHYSICS_FPS off TIM6, frames at SIM_RENDER_FPS
+// (see sim_tick.h)
+#define SIM_PHYSICS_FPS 15
+#define SIM_RENDER_FPS 30
 #define SIM_DELAY_MS ((uint32_t)1000 / SIM_PHYSICS_FPS)
 
 #define SIM_ITERATIONS 1
 #define SIM_PARTICLE_COUNT 1500
 
+// RAM budget for what grows with the particle count, the grid and the panel:
+// the particle and cell arrays with the state fluid_sim.c keeps beside them
+// (SIM_*_SIDE_BYTES each), the stream buffer and the render band buffers.
+// main.c adds them up and fails the build past SIM_RAM_BUDGET. The other
+// ~10 KB of the 128 KB hold the drivers, logging and profiling buffers and
+// the stack; tools/ram_report.py shows the real split after a build.
+#define SIM_RAM_BUDGET (118 * 1024)
+#define SIM_PARTICLE_SIDE_BYTES 6 // prev_pos, row_pos
+#define SIM_CELL_SIDE_BYTES 2     // density_field, cell_shade
+
 #define SIM_PARTICLE_RADIUS ((float)0.75)
 
 #define SIM_OBSTACLE_COUNT 0
 #define SIM_DELTATIME ((float)(1) / (float)(SIM_PHYSICS_FPS * SIM_ITERATIONS))
 #define SIM_PARTICLE_SEPARATE_ITERATIONS 1
+#define SIM_GRID_ITERATIONS 1 // incompressibility passes per step
+
+// Working iteration counts, set from the two above and lowered by the frame
+// governor (governor.h). With no separation passes the cell lists are still
+// built and walls still enforced; particles are just not pushed apart.
+extern uint8_t sim_separate_iterations;
+extern uint8_t sim_grid_iterations;
 
 #define SIM_OVERRELAXATION ((float)1.7) // should be between 1 to 2
 // float to int macro found from StackOverflow:
@@ -103,30 +123,81 @@ void Sim_Physics_Init();
 
 void Sim_Physics_Step();
 
-// Stuff related to Rendering (with SPI) (not finished, need more details)
-#define SOLID_COLOR_R 0x10
-#define SOLID_COLOR_G 0x10
-#define SOLID_COLOR_B 0x10
-
-#define WATER_COLOR_R 0x90
-#define WATER_COLOR_G 0x90
-#define WATER_COLOR_B 0x90
-
-#define AIR_COLOR_R 0xFF
-#define AIR_COLOR_G 0xFF
-#define AIR_COLOR_B 0xFF
+// Mean particle speed (cells per second) below which the water counts as
+// settled for the motion gate
+#define SIM_SETTLED_SPEED ((float)0.5)
+
+uint8_t Sim_Settled();
+
+void Sim_ParticleSpeeds(float *mean, float *max);
+
+// Stuff related to Rendering (with SPI)
+// Palette indices, colours and the water shading table come from
+// water_palette.h, generated by tools/gen_water_palette.py.
+
+// Shade water by mean cell speed and particle count (foam where fast or
+// sparse, deeper blue where dense) instead of the flat SIM_PAL_WATER
+#define SIM_SHADE_WATER 1
+
+// Render modes
+// SIM_RENDER_PARTICLES plots one pixel per particle (cost grows with
+// SIM_PARTICLE_COUNT). SIM_RENDER_SURFACE builds a density field from the
+// per-cell particle counts and draws the water surface with marching squares
+// (cost depends only on the grid size).
+// SIM_RENDER_SPLAT accumulates an anti-aliased kernel per particle in fixed
+// point.
+#define SIM_RENDER_PARTICLES 0
+#define SIM_RENDER_SURFACE 1
+#define SIM_RENDER_SPLAT 2
+#define SIM_RENDER_MODE_DEFAULT SIM_RENDER_SURFACE
+
+// density_field value = particle_count * SIM_SURFACE_SCALE (saturating at 255)
+#define SIM_SURFACE_SCALE 32
+// cells at or above this density are inside the water (0.5 particles)
+#define SIM_SURFACE_THRESHOLD 16
+
+// Splat renderer
+#define SIM_SPLAT_BOX 0
+#define SIM_SPLAT_TENT 1
+#define SIM_SPLAT_KERNEL SIM_SPLAT_TENT
+#define SIM_SPLAT_RADIUS 1         // kernel covers 2 * radius + 1 pixels, 1 to 3
+#define SIM_SPLAT_SUBPIXEL_BITS 2  // sub-pixel positions per axis = 1 << bits
+#define SIM_SPLAT_TONE_SHIFT 5     // coverage >> shift = splat_tone level
+
+extern uint8_t sim_render_mode; // takes effect from the next renderImage()
+// Set by the frame governor: draw with SIM_RENDER_PARTICLES, the cheapest
+// mode, whatever sim_render_mode asks for
+extern uint8_t sim_render_degraded;
+// Where the next renderImage() draws particles between the previous (0) and
+// latest (1) physics step. The surface renderer always draws the latest.
+extern float sim_render_alpha;
 
 // Stuff related to Serial Monitor
 #define PREAMBLE "\r\n!START!\r\n"
 #define DELTA_PREAMBLE "\r\n!DELTA!\r\n"
 #define SUFFIX "!END!\r\n"
 
+// Live frame mirroring: streamFrame() sends a PREAMBLE keyframe every
+// SIM_STREAM_KEYFRAME_INTERVAL frames and DELTA_PREAMBLE frames in between.
+// A delta is a 16-bit little endian payload length, then the XOR against the
+// previous frame PackBits encoded row by row, then SUFFIX. Frames go over
+// USB CDC at the full frame rate while a host has that port open.
+#define SIM_STREAM_FRAMES 0
+#define SIM_STREAM_KEYFRAME_INTERVAL 30
+
 #define DebugPrints 1
 
+// Prepares the frame for the current sim_render_mode; call before
+// oled_drawframe(renderBand)
 void renderImage();
 
-void dummyImage();
+void renderBand(uint8_t band, uint16_t *dst);
+
+void dummyBand(uint8_t band, uint16_t *dst);
 
 void testPrint(void);
 
+// Sends the current frame as a keyframe or delta; call after renderImage()
+void streamFrame(void);
+
 #endif
\ No newline at end of file
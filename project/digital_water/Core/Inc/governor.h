@@ -0,0 +1,45 @@
+#ifndef __GOVERNOR_H
+#define __GOVERNOR_H
+
+#include "main.h"
+
+// Frame budget governor
+// Each frame's work, the DWT cycles the caller hands gov_frame_end() (the
+// telemetry stages of every task run since the last frame), is held against
+// the time between frames (SystemCoreClock / SIM_RENDER_FPS). The worst drawn frame of
+// every GOV_WINDOW_FRAMES decides: GOV_DOWN_WINDOWS windows in a row over
+// budget step one level down, GOV_UP_WINDOWS in a row under GOV_UP_PERCENT of
+// it step one back up. A step up that is undone
+// within GOV_UP_WINDOWS doubles the wait before the next one (up to
+// GOV_UP_BACKOFF_MAX times), so a level that only just fits doesn't flap.
+//
+// Each level keeps the cuts of the ones before it. Levels that would change
+// nothing with the configured iteration counts are stepped over.
+#define GOV_ENABLE 1
+#define GOV_WINDOW_FRAMES 8
+#define GOV_DOWN_WINDOWS 2
+#define GOV_UP_WINDOWS 8
+#define GOV_UP_PERCENT 70
+#define GOV_UP_BACKOFF_MAX 3
+
+enum {
+  GOV_LEVEL_FULL,         // as configured
+  GOV_LEVEL_SEPARATE,     // half the separation passes (none from one)
+  GOV_LEVEL_GRID,         // half the grid solver passes, at least one
+  GOV_LEVEL_RENDER,       // sim_render_degraded: particles only
+  GOV_LEVEL_SKIP_DISPLAY, // render and draw every other frame
+  GOV_LEVEL_COUNT
+};
+
+extern uint8_t gov_level;           // GOV_LEVEL_*, reported in telemetry
+extern uint32_t gov_frames_skipped; // frames not drawn at GOV_LEVEL_SKIP_DISPLAY
+
+void gov_init(void);
+// Call as the frame is released
+void gov_frame_begin(void);
+// 0 if this frame is skipped: step physics, but leave the panel as it is
+uint8_t gov_draw_frame(void);
+// Call once the frame's work is done; may change the level for the next one
+void gov_frame_end(uint32_t work_cycles);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef __IRQ_STATS_H
+#define __IRQ_STATS_H
+
+#include "main.h"
+#include "trace.h"
+
+// Interrupt timing
+// Priority plan (NVIC_PRIORITYGROUP_2: preemption 0-3, subpriority 0-3):
+//   0/0 SysTick          HAL_GetTick() must keep running inside handlers
+//   0/1 TIM6             physics tick, the time base the loop steps against
+//   0/2 TIM7             PC sampler (pcsamp.h), so it can sample handlers
+//   1/0 EXTI15_10        accelerometer INT1 and the button
+//   1/1 DMA1_Stream0     SPI3 RX, accelerometer read completion
+//   1/2 DMA1_Stream5     SPI3 TX
+//   2/0 DMA2_Stream3     SPI1 frame DMA, renders the next band in the handler
+//   3/0 USART3           logging
+//   3/1 DMA1_Stream3     USART3 TX
+//   3/2 OTG_FS           USB CDC telemetry
+// The handlers of one bus share a preemption level, so they never interrupt
+// each other half way through the HAL handle or the SPI queue. The frame DMA
+// handler is the long one; it sits under the sensor and tick so they are not
+// held up by it, and over logging so a frame is not held up by a UART burst.
+//
+// IRQ_STATS_ENTER / IRQ_STATS_EXIT bracket each handler, recording its
+// duration (DWT cycles, less the time spent in handlers that preempted it)
+// and emitting the matching trace events. Entry latency is only known where
+// the hardware timestamps the request: irq_stats_latency() takes it from the
+// TIM6 counter, which starts counting at the update event. That is only as
+// fine as one count (lat_step); the dump gives the step with the figures.
+//
+// irq_stats_dump() prints per IRQ the priority read back from the NVIC, the
+// durations, the latency range (its spread is the jitter) and a worst-case
+// blocking bound: the longest run of any other handler at the same preemption
+// level (only one of those can be running when the request arrives) plus the
+// longest runs of every handler at a higher level, each firing once. SysTick,
+// TIM7 and critical sections with interrupts masked are not counted in it.
+#define IRQ_STATS_ENABLE 1
+
+enum {
+  IRQ_STATS_DMA1_STREAM0,
+  IRQ_STATS_DMA1_STREAM3,
+  IRQ_STATS_DMA1_STREAM5,
+  IRQ_STATS_EXTI15_10,
+  IRQ_STATS_TIM6,
+  IRQ_STATS_DMA2_STREAM3,
+  IRQ_STATS_USART3,
+  IRQ_STATS_OTG_FS,
+  IRQ_STATS_COUNT
+};
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t max;      // longest run, cycles
+  uint64_t sum;
+  uint32_t lat_count;
+  uint32_t lat_min;  // entry latency, cycles
+  uint32_t lat_max;
+  uint32_t lat_step; // resolution of the latency figures, cycles
+  uint64_t lat_sum;
+} Irq_Stats_t;
+
+extern Irq_Stats_t irq_stats[IRQ_STATS_COUNT];
+
+#if IRQ_STATS_ENABLE
+#define IRQ_STATS_ENTER(irq) do { irq_stats_enter(irq); TRACE_BEGIN(TRACE_DMA1_STREAM0 + (irq), 0); } while (0)
+#define IRQ_STATS_EXIT(irq, arg) do { TRACE_END(TRACE_DMA1_STREAM0 + (irq), (arg)); irq_stats_exit(irq); } while (0)
+#else
+#define IRQ_STATS_ENTER(irq) TRACE_BEGIN(TRACE_DMA1_STREAM0 + (irq), 0)
+#define IRQ_STATS_EXIT(irq, arg) TRACE_END(TRACE_DMA1_STREAM0 + (irq), (arg))
+#endif
+
+void irq_stats_init(void);
+void irq_stats_reset(void);
+void irq_stats_enter(uint8_t irq);
+void irq_stats_exit(uint8_t irq);
+void irq_stats_latency(uint8_t irq, uint32_t cycles, uint32_t step);
+void irq_stats_dump(void);
+
+#endif
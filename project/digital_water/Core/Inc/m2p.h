@@ -0,0 +1,81 @@
+#ifndef __M2P_H
+#define __M2P_H
+
+// Motion-to-photon latency
+// Every accelerometer set carries the cycle count it was measured at
+// (Accel_Sample_t.stamp), estimated when its DMA read completes: the newest
+// set of a FIFO batch is taken as just measured and each older one as a
+// sample period earlier. The tasks (sched.h) then hand the stamp of the
+// newest set used down the pipeline:
+//
+//   m2p_gravity()        gravity computed from it
+//   m2p_stepped()        first physics step run with that gravity finished
+//   m2p_rendered()       the frame showing that step rendered
+//   m2p_display_start()  the frame handed to oled_drawframe()
+//   m2p_photon()         its last band left SPI1 (DMA completion interrupt)
+//
+// A newer gravity replaces one not yet stepped, and a newer step one not yet
+// rendered, so each figure is the age of the freshest input the panel shows.
+// Frames that bring no new step are not counted. m2p_collect(), once per
+// frame in the telemetry task, files finished frames into per-hop
+// distributions: min, max, mean and a histogram of M2P_BUCKET_US buckets for
+// the median and the 99th percentile (the top of their bucket). m2p_dump()
+// prints them.
+//
+// With M2P_HOST the cycle counter is m2p_host_cycles, which the caller
+// advances, so tools/m2p_sim.c runs the same bookkeeping on a simulated
+// clock to weigh buffering and scheduling choices.
+#define M2P_ENABLE 1
+#define M2P_BUCKET_US 2000
+#define M2P_BUCKETS 64        // the last one also takes everything above
+#define M2P_HOST_HZ 168000000
+
+#ifdef M2P_HOST
+#ifndef PROF_HOST
+#error "Build the host m2p.c with PROF_HOST as well"
+#endif
+#include <stdint.h>
+extern uint32_t m2p_host_cycles;
+#define M2P_NOW() m2p_host_cycles
+#define M2P_CORE_HZ M2P_HOST_HZ
+#else
+#include "main.h"
+#define M2P_NOW() (DWT->CYCCNT)
+#define M2P_CORE_HZ SystemCoreClock
+#endif
+
+enum {
+  M2P_HOP_FILTER,   // sample measured to gravity computed
+  M2P_HOP_STEP,     // gravity to the end of the step using it
+  M2P_HOP_RENDER,   // step to the frame rendered
+  M2P_HOP_DISPLAY,  // rendered to the last band sent
+  M2P_HOP_TOTAL,    // sample to the last band sent
+  M2P_HOP_COUNT
+};
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t min;  // cycles
+  uint32_t max;
+  uint64_t sum;
+  uint16_t hist[M2P_BUCKETS];
+} M2p_Hop_t;
+
+extern M2p_Hop_t m2p_hops[M2P_HOP_COUNT];
+
+void m2p_init(void);
+void m2p_reset(void);
+// Stamp for set index of count read in one batch, the last being the newest
+uint32_t m2p_sample_stamp(uint8_t index, uint8_t count, uint32_t sample_hz);
+void m2p_gravity(uint32_t sample_stamp);
+void m2p_stepped(void);
+void m2p_rendered(void);
+void m2p_display_start(void);
+void m2p_photon(void);
+void m2p_collect(void);
+// Percentile (0-100) of a hop in microseconds
+uint32_t m2p_percentile_us(uint8_t hop, uint8_t percent);
+void m2p_dump(void);
+
+#endif
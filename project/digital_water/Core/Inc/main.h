@@ -54,6 +54,7 @@ void Error_Handler(void);
 
 /* USER CODE BEGIN EFP */
 void print_msg(char *msg);
+uint32_t apb1_timer_clock(void);
 /* USER CODE END EFP */
 
 /* Private defines -----------------------------------------------------------*/
@@ -49,6 +49,7 @@
 #define CMD_ENABLE_LINEAR_GRAY_SCALE_TABLE  0xB9
 #define CMD_SET_PRECHARGE_VOLTAGE           0xBB
 #define CMD_SET_V_VOLTAGE                   0xBE
+#define CMD_NOP                             0xE3
 
 #define RGB(R,G,B)                  (((R>>3)<<11) | ((G>>2)<<5) | (B>>3))
 // 65k color scheme
@@ -70,17 +71,43 @@
 #define GREEN 0b00011100
 #define BLUE 0b00000011
 */
+
+// Band streaming
+// There is no full framebuffer. The frame is sent in horizontal bands of
+// OLED_BAND_ROWS rows; each band is rendered into a small ring of RGB565
+// buffers by a callback and DMA'd out while the next band is rendered.
+#define OLED_BAND_ROWS                      4 // must divide RGB_OLED_HEIGHT
+#define OLED_BAND_BUFFERS                   2 // ring depth, at least 2
+#define OLED_BAND_PIXELS                    (RGB_OLED_WIDTH * OLED_BAND_ROWS)
+#define OLED_BAND_COUNT                     (RGB_OLED_HEIGHT / OLED_BAND_ROWS)
+
+#if (RGB_OLED_HEIGHT % OLED_BAND_ROWS) != 0
+#error "OLED_BAND_ROWS must divide RGB_OLED_HEIGHT"
+#endif
+#if OLED_BAND_BUFFERS < 2
+#error "OLED_BAND_BUFFERS must be at least 2"
+#endif
+
+// Fills dst with OLED_BAND_PIXELS RGB565 pixels for rows
+// [band * OLED_BAND_ROWS, (band + 1) * OLED_BAND_ROWS). Called from the SPI1
+// DMA completion interrupt for every band after the first few.
+typedef void (*oled_band_fn)(uint8_t band, uint16_t *dst);
+
 HAL_StatusTypeDef oled_init(void);
 HAL_StatusTypeDef oled_write(uint8_t val);
 HAL_StatusTypeDef oled_off(void);
 HAL_StatusTypeDef oled_drawpixel(uint8_t col, uint8_t row, uint16_t color);
 HAL_StatusTypeDef oled_data(uint8_t data);
 HAL_StatusTypeDef oled_cmd(uint8_t cmd);
+HAL_StatusTypeDef oled_cmds(const uint8_t *cmds, uint16_t len);
 void oled_drawline(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t color);
 void oled_eraseRect(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
 void oled_drawRect(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t border_col, uint16_t fill_col);
 void oled_drawRectDMA(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t border_col, uint16_t fill_col);
-void oled_drawframe(uint16_t* pixel_buff);
+void oled_drawframe(oled_band_fn render_band);
+uint8_t oled_frame_busy(void);
+
+extern uint32_t oled_tx_bytes;
 
 
 #endif
\ No newline at end of file
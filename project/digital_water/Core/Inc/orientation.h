@@ -0,0 +1,39 @@
+#ifndef __ORIENTATION_H
+#define __ORIENTATION_H
+
+#include <stdint.h>
+
+// Gravity direction from the accelerometer
+// The screen only needs the direction of gravity in the X/Y plane. Going
+// through roll/pitch is a round trip: sin(atan(a / sqrt(b^2 + c^2))) is just
+// a / |accel|, so once normalised in 2D the direction is (-y, x) / |(x, y)|.
+// orient_gravity() computes that in single precision, one sqrtf and a divide,
+// all of which the M4 FPU does in hardware.
+//
+// orient_update() runs once per sample (sensor rate, not frame rate) and low
+// pass filters the raw counts in fixed point with ORIENT_FILTER_FRAC
+// fractional bits: s += (raw - s) >> ORIENT_FILTER_SHIFT. ORIENT_FILTER_SHIFT 0
+// passes samples straight through.
+//
+// Nothing here touches the HAL unless ORIENT_PROFILE is set, so the module
+// also builds on the host with ORIENT_HOST (see tools/orient_replay.c).
+#define ORIENT_FILTER_SHIFT 2   // time constant of ~4 samples, 40 ms at 100 Hz
+#define ORIENT_FILTER_FRAC 8    // fractional bits of the filter state
+#define ORIENT_MIN_TILT 64      // |(x, y)| in counts (~64 mg) below which the direction is held
+#define ORIENT_PROFILE 1        // DWT cycle counts in orient_update_cycles / orient_gravity_cycles
+
+#if ORIENT_FILTER_SHIFT > ORIENT_FILTER_FRAC || ORIENT_FILTER_FRAC > 16
+#error "bad orientation filter configuration"
+#endif
+
+#if ORIENT_PROFILE && !defined(ORIENT_HOST)
+extern volatile uint32_t orient_update_cycles;
+extern volatile uint32_t orient_gravity_cycles;
+#endif
+
+void orient_reset(void);
+void orient_update(int16_t x, int16_t y, int16_t z);
+void orient_filtered(int16_t *xyz);
+uint8_t orient_gravity(float *gx, float *gy);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef __PCSAMP_H
+#define __PCSAMP_H
+
+#include "main.h"
+
+// Statistical PC sampler
+// TIM7 interrupts PCSAMP_HZ times a second (each period dithered by up to
+// PCSAMP_DITHER_US so it cannot lock to other periodic work) and counts the
+// PC stacked in its exception frame into a histogram of 1 << PCSAMP_BUCKET_BITS
+// byte buckets over the first PCSAMP_SPAN bytes of flash. Samples outside
+// that go to pcsamp_outside. Time the scheduler spends idle shows up as the
+// WFI in sched_run().
+//
+// A sample costs a few dozen cycles, so the overhead is bounded by the rate:
+// at PCSAMP_MAX_HZ it stays well under 1%. Sampling stops by itself once a
+// bucket is about to saturate.
+//
+// TIM7 runs at preemption level 0 (irq_stats.h), so it samples inside every
+// handler but the tick's; pcsamp_in_handler counts the samples that landed
+// in one.
+//
+// pcsamp_dump() sends the counts as telemetry packets (TELEM_TYPE_PCSAMP_*);
+// tools/pcsamp_report.py attributes them to functions using the linker map.
+// The histogram takes 2 bytes a bucket, 4 KB as configured, so it is off by
+// default.
+#define PCSAMP_ENABLE 0
+#define PCSAMP_HZ 2000
+#define PCSAMP_MAX_HZ 10000
+#define PCSAMP_DITHER_US 15   // power of two minus one
+#define PCSAMP_BUCKET_BITS 5  // 32 byte buckets
+#define PCSAMP_SPAN 0x10000   // bytes of flash covered, from FLASH_BASE
+#define PCSAMP_BUCKETS (PCSAMP_SPAN >> PCSAMP_BUCKET_BITS)
+
+#if PCSAMP_HZ > PCSAMP_MAX_HZ
+#error "PCSAMP_HZ is over PCSAMP_MAX_HZ"
+#endif
+
+// TELEM_TYPE_PCSAMP_INFO payload
+typedef struct
+{
+  uint32_t base;          // address of bucket 0
+  uint32_t samples;       // taken since pcsamp_reset(), in or out of the span
+  uint32_t outside;
+  uint32_t in_handler;
+  uint16_t rate_hz;
+  uint8_t bucket_bits;
+  uint8_t stopped_full;   // 1 if sampling stopped on a full bucket
+} Pcsamp_Info_t;
+
+// TELEM_TYPE_PCSAMP_BUCKETS payload: up to PCSAMP_PAIRS_PER_PACKET of these,
+// non-empty buckets only
+typedef struct
+{
+  uint16_t bucket;
+  uint16_t count;
+} Pcsamp_Pair_t;
+
+#define PCSAMP_PAIRS_PER_PACKET 60
+
+extern volatile uint32_t pcsamp_samples;
+extern volatile uint32_t pcsamp_outside;
+extern volatile uint32_t pcsamp_in_handler;
+
+void pcsamp_start(void);
+void pcsamp_stop(void);
+void pcsamp_reset(void);
+// Sends the histogram, pausing sampling meanwhile; waits for room on the link
+void pcsamp_dump(void);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef __PROF_H
+#define __PROF_H
+
+// Stage profiler
+// PROF_BEGIN(scope) / PROF_END(scope) around a piece of the main loop charge
+// the DWT cycles between them to that scope. Each scope keeps its count, min,
+// max and sum, and a log-linear histogram (PROF_SUB_BUCKETS per power of two
+// from 2^PROF_MIN_BITS cycles) for the 99th percentile, which is reported as
+// the top of its bucket, so it reads up to 1/PROF_SUB_BUCKETS high.
+// prof_dump() prints the table through print_msg().
+//
+// Scopes may nest, but each one only once at a time, and only from the main
+// loop. Each scope is also a trace event (trace.h). With PROF_HOST the cycle
+// counter is replaced by the host's monotonic clock, scaled to PROF_HOST_HZ,
+// so the same code runs in a Linux build (see tools/prof_host.c).
+//
+// The other cycle-counting modules (telemetry, trace, irq_stats, m2p, sched,
+// ...) start the counter with prof_cycles_enable() and print their tables
+// with PROF_PRINT(); their host builds define PROF_HOST too.
+#define PROF_ENABLE 1
+#define PROF_MIN_BITS 8      // everything under 256 cycles shares a bucket
+#define PROF_OCTAVES 20      // up to 2^28 cycles, 1.6 s at 168 MHz
+#define PROF_SUB_BUCKETS 4   // power of two
+#define PROF_BUCKETS (2 + PROF_OCTAVES * PROF_SUB_BUCKETS) // plus under and over
+#define PROF_HOST_HZ 168000000
+
+#ifdef PROF_HOST
+#include <stdint.h>
+#include <stdio.h>
+uint32_t prof_host_cycles(void);
+#define PROF_CYCLES() prof_host_cycles()
+#define PROF_TRACE(trace, scope) ((void)0)
+#define PROF_PRINT(text) fputs((text), stdout)
+#define prof_cycles_enable() ((void)0)
+#else
+#include "main.h"
+#include "trace.h"
+#define PROF_CYCLES() (DWT->CYCCNT)
+#define PROF_PRINT(text) print_msg(text)
+// Starts DWT->CYCCNT, which is off out of reset; any module may call it
+void prof_cycles_enable(void);
+// Scopes are traced too, as the TRACE_* events that follow TRACE_ACCEL_POLL
+#define PROF_TRACE(trace, scope) trace(TRACE_ACCEL_POLL + (scope), 0)
+#endif
+
+enum {
+  PROF_ACCEL_POLL,         // draining the sample ring through the orientation filter
+  PROF_SIM_PARTICLE_STEP,  // Sim_Particle_Step
+  PROF_SIM_PUSH_APART,     // Sim_Particle_PushParticlesApart
+  PROF_SIM_TO_GRID,        // Sim_TransferVelocities(1)
+  PROF_SIM_GRID_STEP,      // Sim_Grid_Step, every pass
+  PROF_SIM_TO_PARTICLES,   // Sim_TransferVelocities(0)
+  PROF_RENDER_IMAGE,       // renderImage
+  PROF_OLED_DRAWFRAME,     // oled_drawframe until it returns
+  PROF_SCOPE_COUNT
+};
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint32_t hist_total;              // count since the histogram last halved
+  uint16_t hist[PROF_BUCKETS];
+} Prof_Scope_t;
+
+extern Prof_Scope_t prof_scopes[PROF_SCOPE_COUNT];
+extern uint32_t prof_start[PROF_SCOPE_COUNT];
+
+#if PROF_ENABLE
+#define PROF_BEGIN(scope) (PROF_TRACE(TRACE_BEGIN, scope), prof_start[scope] = PROF_CYCLES())
+#define PROF_END(scope) (prof_record((scope), PROF_CYCLES() - prof_start[scope]), PROF_TRACE(TRACE_END, scope))
+#else
+#define PROF_BEGIN(scope) ((void)0)
+#define PROF_END(scope) ((void)0)
+#endif
+
+void prof_init(void);
+void prof_reset(void);
+void prof_record(uint8_t scope, uint32_t cycles);
+// Cycles at or under which 99% of the scope's samples fall, 0 if none
+uint32_t prof_p99(uint8_t scope);
+void prof_dump(void);
+
+#endif
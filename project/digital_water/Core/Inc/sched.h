@@ -0,0 +1,76 @@
+#ifndef __SCHED_H
+#define __SCHED_H
+
+// Cooperative run-to-completion scheduler
+// A fixed table of SCHED_TASK_COUNT tasks, filled once by sched_task_init()
+// and run by sched_run(), which never returns. A task is released either
+// every period_ms (HAL_GetTick(), so SysTick is the time base) or by
+// sched_signal(), which interrupt handlers call for the event that task
+// waits on. Of the released tasks the one with the lowest priority number
+// runs, to completion; ties go to the lower task ID. With none released the
+// core sleeps in WFI until an interrupt, SysTick at the latest.
+//
+// A release that finds the task still pending merges into it and is counted
+// as an overrun; a periodic task late by more than a period gives up the
+// slots it missed rather than running back to back. Each run's cycles (DWT)
+// and its response time, release to completion in milliseconds, are kept
+// per task; a response over deadline_ms counts a miss. sched_dump() prints
+// the table and the share of time spent idle.
+//
+// With SCHED_HOST the tick and the cycle counter are sched_host_ms and
+// sched_host_cycles, which the caller advances, and the idle sleep is
+// sched_host_idle(), which stands in for the interrupts; sched_run() returns
+// once it returns 0. tools/sched_sim.c drives the scheduler that way.
+#ifdef SCHED_HOST
+#ifndef PROF_HOST
+#error "Build the host sched.c with PROF_HOST as well"
+#endif
+#include <stdint.h>
+#define SCHED_HOST_HZ 168000000
+extern uint32_t sched_host_ms;
+extern uint32_t sched_host_cycles;
+uint8_t sched_host_idle(void);
+#else
+#include "main.h"
+#endif
+
+enum {
+  SCHED_TASK_SENSOR,    // sample ring through the orientation filter
+  SCHED_TASK_DISPLAY,   // hand the rendered frame to the panel
+  SCHED_TASK_PHYSICS,   // Sim_Physics_Step for each TIM6 tick due
+  SCHED_TASK_RENDER,    // motion gate, governor, renderImage
+  SCHED_TASK_TELEMETRY, // frame packet, latency figures, button dumps
+  SCHED_TASK_COUNT
+};
+
+typedef void (*Sched_Fn_t)(void);
+
+typedef struct
+{
+  const char *name;
+  Sched_Fn_t run;
+  uint8_t priority;       // 0 runs first
+  uint16_t period_ms;     // 0: released by sched_signal() only
+  uint16_t deadline_ms;   // release to completion, 0 for none
+  volatile uint8_t ready;
+  volatile uint32_t release; // HAL_GetTick() of the pending release
+  uint32_t next;             // next periodic release
+  // Accounting
+  uint32_t runs;
+  uint32_t misses;            // finished more than deadline_ms after release
+  volatile uint32_t overruns; // releases merged into a pending one
+  uint32_t max_response;      // ms
+  uint32_t max_cycles;
+  uint64_t sum_cycles;
+} Sched_Task_t;
+
+void sched_task_init(uint8_t task, const char *name, Sched_Fn_t run, uint8_t priority, uint16_t period_ms,
+                     uint16_t deadline_ms);
+// Releases a task; safe from interrupt handlers
+void sched_signal(uint8_t task);
+void sched_run(void);
+void sched_dump(void);
+// One task's accounting
+const Sched_Task_t *sched_task(uint8_t task);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __SIM_TICK_H
+#define __SIM_TICK_H
+
+#include "main.h"
+
+// Fixed-rate physics clock
+// TIM6 overflows SIM_PHYSICS_FPS times a second and releases the physics task
+// (sched.h), which runs one Sim_Physics_Step() per overflow, so simulated time
+// (SIM_DELTATIME per step) tracks wall-clock time however long rendering
+// takes. Frames are released separately at SIM_RENDER_FPS and drawn between
+// the last two physics states (sim_render_alpha).
+//
+// Steps the task falls behind on are caught up, at most SIM_MAX_CATCHUP_STEPS
+// per run; the rest are dropped, and simulated time slips by that much.
+// TIM6 count rate: as fast as a 16-bit period allows at SIM_PHYSICS_FPS, and
+// a divisor of the 84 MHz timer clock. The TIM6 latency figures come in steps
+// of one count, 200 cycles at 168 MHz.
+#define SIM_TICK_COUNTER_HZ 840000
+#define SIM_MAX_CATCHUP_STEPS 2
+
+extern volatile uint32_t sim_ticks_late;    // steps run a tick or more after they were due
+extern volatile uint32_t sim_ticks_dropped; // ticks skipped rather than caught up
+
+// Programs TIM6 for the physics rate and starts it with the counters at zero.
+// Also used to resume after the motion gate, so the ticks slept through are
+// not taken as a backlog.
+void sim_tick_start(void);
+void sim_tick_stop(void);
+// Physics steps due now, counting late and dropped ones; run them all
+uint8_t sim_tick_take(void);
+// How far into the current tick the clock is, 0 to 1
+float sim_tick_alpha(void);
+
+#endif
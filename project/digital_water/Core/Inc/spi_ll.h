@@ -0,0 +1,29 @@
+#ifndef __SPI_LL_H
+#define __SPI_LL_H
+
+#include "main.h"
+#include "stm32f4xx_ll_spi.h"
+#include "stm32f4xx_ll_gpio.h"
+
+// Register level SPI for short transactions
+// HAL_SPI_Transmit/TransmitReceive lock the handle, run the state machine and
+// poll with a HAL_GetTick() timeout around every byte; for the one to three
+// byte OLED commands and accelerometer register accesses that costs more than
+// the transfer. spi_ll_transfer() writes DR and polls SR directly instead.
+// Chip selects and DC go through BSRR with LL_GPIO_SetOutputPin /
+// LL_GPIO_ResetOutputPin (the HAL GPIO_PIN_x masks are the same values).
+// DMA transfers (frame bands, async accelerometer reads) stay on HAL.
+//
+// The caller owns the bus: nothing may be running on it by DMA.
+// SPI_LL_BENCH 1 prints the cycles per transaction of both paths at startup.
+#define SPI_LL_TIMEOUT_LOOPS 100000  // spins on one flag before giving up
+#define SPI_LL_BENCH 0               // time HAL vs LL transactions at startup
+
+HAL_StatusTypeDef spi_ll_transfer(SPI_TypeDef *spi, const uint8_t *tx, uint8_t *rx, uint16_t len);
+
+#if SPI_LL_BENCH
+void spi_ll_benchmark(const char *name, SPI_HandleTypeDef *hspi, GPIO_TypeDef *cs_port,
+                      uint16_t cs_pin, const uint8_t *tx, uint16_t len);
+#endif
+
+#endif
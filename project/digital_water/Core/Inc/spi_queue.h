@@ -0,0 +1,56 @@
+#ifndef __SPI_QUEUE_H
+#define __SPI_QUEUE_H
+
+#include "main.h"
+
+// SPI transaction queue
+// Each SPI peripheral has a queue of transfer descriptors run back to back by
+// DMA: the completion interrupt raises CS, starts the next descriptor, and only
+// then calls the finished one's callback, so the bus stays busy while the
+// callback works (renders the next band, parses a read).
+// Descriptors are owned by the caller and linked through next, like the
+// particle lists in the grid cells; nothing is allocated. A descriptor can be
+// queued once at a time and may be resubmitted from its own callback.
+//
+// The queue owns HAL_SPI_TxCpltCallback, HAL_SPI_TxRxCpltCallback and
+// HAL_SPI_ErrorCallback. Blocking spi_ll transfers must not be used on a bus
+// while its queue is busy.
+
+#define SPI_XFER_IDLE 0
+#define SPI_XFER_QUEUED 1
+#define SPI_XFER_ACTIVE 2
+
+typedef struct spi_xfer Spi_Xfer_t;
+
+// Called from the DMA completion (or error) interrupt
+typedef void (*spi_xfer_fn)(Spi_Xfer_t *xfer, HAL_StatusTypeDef status);
+
+struct spi_xfer {
+  GPIO_TypeDef *cs_port;
+  uint16_t cs_pin;
+  GPIO_TypeDef *dc_port;  // NULL if the device has no DC line
+  uint16_t dc_pin;
+  uint8_t dc;             // DC level for the whole transfer
+  const uint8_t *tx;
+  uint8_t *rx;            // NULL for transmit only (SPI1 has no RX DMA)
+  uint16_t len;
+  spi_xfer_fn done;       // may be NULL
+  volatile uint8_t state; // SPI_XFER_*
+  Spi_Xfer_t *next;
+};
+
+typedef struct
+{
+  SPI_HandleTypeDef *hspi;
+  Spi_Xfer_t *head;       // next to start
+  Spi_Xfer_t *tail;
+  Spi_Xfer_t *volatile active; // on the bus
+} Spi_Queue_t;
+
+extern Spi_Queue_t spi1_queue; // OLED
+extern Spi_Queue_t spi3_queue; // ADXL362
+
+HAL_StatusTypeDef spi_queue_submit(Spi_Queue_t *queue, Spi_Xfer_t *xfer);
+uint8_t spi_queue_idle(Spi_Queue_t *queue);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef __STACK_PAINT_H
+#define __STACK_PAINT_H
+
+#include "main.h"
+
+// Stack high-water mark
+// main() and every interrupt handler share the one stack reserved by
+// startup_stm32f446xx.s (Stack_Size, sized there from an estimate of the
+// deepest main loop path plus the worst interrupt nesting). stack_paint(), first thing in main(),
+// fills the part below the caller's frame with STACK_PAINT_WORD;
+// stack_high_water() scans up from the bottom for the first word that
+// changed, giving the deepest the stack has reached since, in bytes. A value
+// equal to stack_size() means it ran out: the stack grows down into HEAP and
+// then the static data under it, with nothing to catch it.
+//
+// The scan is a few hundred word reads, so query it from the main loop (the
+// button dump), not every frame. tools/ram_report.py covers static RAM.
+#define STACK_PAINT_ENABLE 1
+#define STACK_PAINT_WORD 0xC5C5C5C5u
+
+void stack_paint(void);
+uint32_t stack_size(void);
+uint32_t stack_high_water(void);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#include "main.h"
+
+// Binary telemetry over USART3
+// One packet per TELEM_DECIMATION frames, queued on the same USART3 DMA ring
+// as the deferred log (dlog_raw), so it never waits on the UART. While a host
+// has the USB CDC port open, every frame's packet goes there instead:
+//
+//   TELEM_SYNC (2 bytes, LE), type, payload length, payload, CRC-16 (LE)
+//
+// The CRC is CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) over type, length
+// and payload. tools/telem_decode.py turns a capture into CSV.
+//
+// Each task brackets its work with telem_stage_begin() and telem_stage_end();
+// the time between is charged to that stage in DWT cycles, adding up over
+// every task run since the last telem_frame_end, which starts the next frame.
+#define TELEM_ENABLE 1
+#define TELEM_DECIMATION 2        // send every Nth frame
+#define TELEM_WAIT_MS 100         // telem_send_wait() gives up after this
+#define TELEM_SYNC 0xA55A
+#define TELEM_TYPE_FRAME 0x01
+#define TELEM_TYPE_PCSAMP_INFO 0x02    // Pcsamp_Info_t (pcsamp.h)
+#define TELEM_TYPE_PCSAMP_BUCKETS 0x03 // Pcsamp_Pair_t array
+#define TELEM_TYPE_TRACE_INFO 0x04     // Trace_Info_t (trace.h)
+#define TELEM_TYPE_TRACE 0x05          // Trace_Record_t array
+
+enum {
+  TELEM_STAGE_ACCEL,    // draining samples, orientation
+  TELEM_STAGE_PHYSICS,  // Sim_Physics_Step, once per tick due
+  TELEM_STAGE_RENDER,   // renderImage: bins / fields for the frame
+  TELEM_STAGE_DISPLAY,  // oled_drawframe until it returns
+  TELEM_STAGE_COUNT
+};
+
+// TELEM_TYPE_FRAME payload, little endian, no padding (widest fields first)
+typedef struct
+{
+  uint32_t frame;                           // frames since boot
+  uint32_t tick_ms;                         // HAL_GetTick() at the end of the frame
+  uint32_t stage_cycles[TELEM_STAGE_COUNT]; // DWT cycles per stage
+  uint32_t frame_cycles;                    // since the last telem_frame_end, idle included
+  uint32_t oled_bytes;                      // bytes queued to the OLED this frame
+  float gravity_x;
+  float gravity_y;
+  float mean_speed;                         // particle speed, cells per second
+  float max_speed;
+  uint16_t accel_samples;                   // samples consumed this frame
+  uint16_t physics_steps;                   // Sim_Physics_Step calls this frame
+  uint16_t ticks_late;                      // sim_ticks_late, truncated
+  uint16_t ticks_dropped;                   // sim_ticks_dropped, truncated
+  uint16_t gov_level;                       // frame governor level, GOV_LEVEL_*
+  uint16_t frames_skipped;                  // gov_frames_skipped, truncated
+} Telem_Frame_t;
+
+extern uint32_t telem_dumps_cut; // dumps dropped part way by telem_send_wait()
+
+void telem_init(void);
+void telem_stage_begin(void);
+void telem_stage_end(uint8_t stage);
+// Stage cycles of the frame so far, summed: its work without the idle time
+uint32_t telem_frame_work(void);
+void telem_frame_end(uint16_t accel_samples, uint16_t physics_steps);
+// 0 if the USB staging buffer had no room and the packet was dropped
+uint8_t telem_send(uint8_t type, const void *payload, uint8_t len);
+// Waits for room instead, for dumps: the UART ring is flushed first, USB is
+// retried until its staging buffer takes the packet. A host that holds the
+// port open but stops reading would hold the main loop here, so after
+// TELEM_WAIT_MS it gives up, counts the dump in telem_dumps_cut and returns 0;
+// the caller drops the rest of the dump.
+uint8_t telem_send_wait(uint8_t type, const void *payload, uint8_t len);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include "main.h"
+
+// Event trace
+// TRACE_BEGIN / TRACE_END / TRACE_MARK append an 8-byte record (DWT cycle
+// count, event, phase, 16-bit argument) to a RAM ring of TRACE_RECORDS,
+// overwriting the oldest. Slots are claimed with LDREX/STREX, so interrupt
+// handlers and the main loop write without masking interrupts; a writer that
+// is preempted between taking its timestamp and claiming a slot can land
+// slightly out of order, which the host sorts out.
+//
+// Profiler scopes (PROF_BEGIN / PROF_END) are traced as well, so the main
+// loop stages show up without extra calls.
+//
+// trace_dump() sends the ring oldest first as telemetry packets
+// (TELEM_TYPE_TRACE_*); tools/trace_to_chrome.py turns a capture into Chrome
+// trace-event JSON for chrome://tracing or Perfetto. Off by default: the
+// ring is 8 * TRACE_RECORDS bytes of RAM.
+#define TRACE_ENABLE 0
+#define TRACE_RECORDS 512 // power of two
+
+#if TRACE_RECORDS & (TRACE_RECORDS - 1)
+#error "TRACE_RECORDS must be a power of two"
+#endif
+
+enum {
+#define TRACE_EVENT(id, track, name) id,
+#include "trace_events.h"
+#undef TRACE_EVENT
+  TRACE_EVENT_COUNT
+};
+
+#define TRACE_PH_BEGIN 0
+#define TRACE_PH_END 1
+#define TRACE_PH_MARK 2
+
+typedef struct
+{
+  uint32_t cycles; // DWT->CYCCNT
+  uint8_t event;   // TRACE_*
+  uint8_t phase;   // TRACE_PH_*
+  uint16_t arg;
+} Trace_Record_t;
+
+// TELEM_TYPE_TRACE_INFO payload
+typedef struct
+{
+  uint32_t core_hz;  // DWT cycles per second
+  uint32_t written;  // records since trace_reset(), including overwritten ones
+  uint16_t records;  // ring size
+  uint16_t reserved;
+} Trace_Info_t;
+
+#define TRACE_RECORDS_PER_PACKET 31
+
+#if TRACE_ENABLE
+#define TRACE_BEGIN(event, arg) trace_write((event), TRACE_PH_BEGIN, (arg))
+#define TRACE_END(event, arg) trace_write((event), TRACE_PH_END, (arg))
+#define TRACE_MARK(event, arg) trace_write((event), TRACE_PH_MARK, (arg))
+#else
+#define TRACE_BEGIN(event, arg) ((void)0)
+#define TRACE_END(event, arg) ((void)0)
+#define TRACE_MARK(event, arg) ((void)0)
+#endif
+
+void trace_init(void);
+void trace_reset(void);
+void trace_write(uint8_t event, uint8_t phase, uint16_t arg);
+// Stops recording, sends the ring and starts over with it empty
+void trace_dump(void);
+
+#endif
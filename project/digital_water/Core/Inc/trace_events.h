@@ -0,0 +1,31 @@
+// Trace event IDs, one TRACE_EVENT(id, track, name) per line.
+// Records carry only the ID; tools/trace_to_chrome.py reads this file for
+// the names, and puts each event on the timeline row of its track (MAIN for
+// the main loop, IRQ for interrupt handlers). The ID is the position in the
+// list.
+// No include guard: trace.h includes this with TRACE_EVENT defined.
+
+TRACE_EVENT(TRACE_IDLE, MAIN, "idle")
+TRACE_EVENT(TRACE_FRAME, MAIN, "frame")
+TRACE_EVENT(TRACE_MOTION_SLEEP, MAIN, "motion_sleep")
+TRACE_EVENT(TRACE_TASK, MAIN, "task") // arg: SCHED_TASK_*
+
+// Profiler scopes (prof.h), in PROF_* order
+TRACE_EVENT(TRACE_ACCEL_POLL, MAIN, "accel_poll")
+TRACE_EVENT(TRACE_SIM_PARTICLE_STEP, MAIN, "Sim_Particle_Step")
+TRACE_EVENT(TRACE_SIM_PUSH_APART, MAIN, "Sim_PushParticlesApart")
+TRACE_EVENT(TRACE_SIM_TO_GRID, MAIN, "Sim_TransferVelocities(1)")
+TRACE_EVENT(TRACE_SIM_GRID_STEP, MAIN, "Sim_Grid_Step")
+TRACE_EVENT(TRACE_SIM_TO_PARTICLES, MAIN, "Sim_TransferVelocities(0)")
+TRACE_EVENT(TRACE_RENDER_IMAGE, MAIN, "renderImage")
+TRACE_EVENT(TRACE_OLED_DRAWFRAME, MAIN, "oled_drawframe")
+
+// Interrupt handlers, in IRQ_STATS_* order (irq_stats.h)
+TRACE_EVENT(TRACE_DMA1_STREAM0, IRQ, "DMA1_Stream0 SPI3 RX")
+TRACE_EVENT(TRACE_DMA1_STREAM3, IRQ, "DMA1_Stream3 USART3 TX")
+TRACE_EVENT(TRACE_DMA1_STREAM5, IRQ, "DMA1_Stream5 SPI3 TX")
+TRACE_EVENT(TRACE_EXTI15_10, IRQ, "EXTI15_10")
+TRACE_EVENT(TRACE_TIM6, IRQ, "TIM6")
+TRACE_EVENT(TRACE_DMA2_STREAM3, IRQ, "DMA2_Stream3 SPI1 TX")
+TRACE_EVENT(TRACE_USART3, IRQ, "USART3")
+TRACE_EVENT(TRACE_OTG_FS, IRQ, "OTG_FS")
@@ -0,0 +1,22 @@
+#ifndef __USB_CDC_H
+#define __USB_CDC_H
+
+#include "main.h"
+#include "usb_cdc_tx.h"
+
+// USB CDC-ACM device on USB_OTG_FS
+// A minimal virtual COM port straight on the HAL PCD driver: enumeration,
+// the ACM line requests and one bulk IN/OUT pair. Data the host sends is
+// discarded. Once a terminal opens the port (DTR), frame mirroring and
+// telemetry go out here at bulk speed instead of USART3; see usb_cdc_tx.h for
+// the streaming side. The tools in tools/ read the port like a UART capture.
+//
+// The driver owns the HAL_PCD_* callbacks.
+#define USB_CDC_ENABLE 1
+#define USB_CDC_VID 0x0483 // ST Virtual COM Port IDs, the host's stock driver binds
+#define USB_CDC_PID 0x5740
+
+// Sets up the FIFOs and connects; call after MX_USB_OTG_FS_PCD_Init()
+void usb_cdc_init(void);
+
+#endif
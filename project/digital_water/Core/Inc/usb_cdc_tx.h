@@ -0,0 +1,47 @@
+#ifndef __USB_CDC_TX_H
+#define __USB_CDC_TX_H
+
+#include <stdint.h>
+
+// USB CDC bulk IN streaming
+// Small records (telemetry packets) are copied whole into one of two staging
+// buffers: while one is on the wire the other takes writes, and the endpoint
+// completion interrupt swaps them. Large blocks (mirrored frames) go out in
+// place from the caller's buffer, one at a time, after any staged bytes, so
+// records are never split by one another. Nothing waits on the host: a
+// record that does not fit is dropped and counted, a block is refused while
+// the previous one is still in flight.
+//
+// A transfer that ends on a full packet is followed by a zero length packet
+// once nothing else is queued, so the host read completes.
+//
+// This file has no hardware dependencies: usb_cdc.c provides
+// usb_cdc_ep_transmit() on the target, tools/usb_cdc_sim.c on the host
+// (built with USB_CDC_HOST).
+#define USB_CDC_MAX_PACKET 64
+#define USB_CDC_TX_BUF_SIZE 512 // each of the two staging buffers
+
+// Starts a bulk IN transfer; returns 0 once it is queued. Completion is
+// reported through usb_cdc_tx_done().
+uint8_t usb_cdc_ep_transmit(const uint8_t *data, uint32_t len);
+
+extern volatile uint32_t usb_cdc_tx_dropped; // records lost to full buffers
+extern volatile uint32_t usb_cdc_tx_bytes;   // bytes handed to the endpoint
+
+// Port opened or closed by the host (DTR). Closing drops everything queued;
+// a transfer already in flight still completes.
+void usb_cdc_tx_open(uint8_t open);
+// Bus reset or deconfigure: the endpoint is gone, forget everything
+void usb_cdc_tx_reset(void);
+// Bulk IN transfer complete, from the USB interrupt
+void usb_cdc_tx_done(void);
+
+uint8_t usb_cdc_is_open(void);
+// Queues a whole record; returns 0 if the port is closed or it does not fit
+uint8_t usb_cdc_write(const void *data, uint16_t len);
+// Sends data in place; it must stay untouched until usb_cdc_block_busy()
+// clears. Returns 0 if the port is closed or a block is already queued.
+uint8_t usb_cdc_send_block(const uint8_t *data, uint32_t len);
+uint8_t usb_cdc_block_busy(void);
+
+#endif
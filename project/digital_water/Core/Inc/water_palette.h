@@ -0,0 +1,29 @@
+// Generated by tools/gen_water_palette.py - do not edit.
+
+#ifndef __WATER_PALETTE_H
+#define __WATER_PALETTE_H
+
+#include <stdint.h>
+
+// Base palette indices
+#define SIM_PAL_BACKGROUND 0
+#define SIM_PAL_WATER 1
+#define SIM_PAL_SOLID 2
+#define SIM_PAL_AIR 3
+
+// Shaded water: SIM_PAL_SHADE_BASE + SIM_SHADE_INDEX(speed, density)
+#define SIM_PAL_SHADE_BASE 4
+#define SIM_SHADE_SPEED_LEVELS 4
+#define SIM_SHADE_DENSITY_LEVELS 4
+#define SIM_SHADE_SPEED_STEP ((float)2.0)
+#define SIM_SHADE_DENSITY_STEP 4
+#define SIM_SHADE_INDEX(speed, density) \
+  ((speed) * SIM_SHADE_DENSITY_LEVELS + (density))
+
+#define SIM_PALETTE_COLORS 20
+#define SIM_SPLAT_TONE_LEVELS 16
+
+extern const uint16_t sim_palette[SIM_PALETTE_COLORS];
+extern const uint16_t splat_tone[SIM_SPLAT_TONE_LEVELS];
+
+#endif
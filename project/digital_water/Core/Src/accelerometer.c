@@ -1,4 +1,9 @@
 #include "accelerometer.h"
+#include "spi_ll.h"
+#include "spi_queue.h"
+#include "dlog.h"
+#include "m2p.h"
+#include "sched.h"
 
 	/* Burst write to initialize registers. Writing to registers 0x20 to 0x2D
 
@@ -20,21 +25,29 @@
 		0x26 - upper 8 bits
 
 	Activity/Inactivity Control : Configure Activity and Inactivity events. Upper 2 bits are unused
-		0x27 - write 0b00[11]1011 --> 0x3B
-		Enables Activity events in "referenced" mode.
+		0x27 - write 0b00[11]1111 --> 0x3F
+		Enables Activity and Inactivity events in "referenced" mode, linked in loop
+		mode: the part alternates between looking for activity and inactivity and
+		tracks which it saw last in STATUS.AWAKE.
 		Activity interrupts do not need to be acknowledged by the STM32.
 
 	FIFO Control : Configure FIFO sample ranges and operating mode. Upper 4 bits unused
-		0x28 - write 0bxxxx00[00] --> 0x00
-		Disables FIFO.
+		0x28 - write 0bxxxx[A]0[10] --> 0x02 (ACCEL_USE_FIFO), else 0x00
+		Stream mode: oldest samples are dropped once the FIFO is full.
+		A is the 9th bit of the watermark (AH).
 
 	FIFO Samples : configure num. samples to store in FIFO
-		0x29 - write 0x00
-		Store 0 samples in FIFO.
+		0x29 - write lower 8 bits of ACCEL_FIFO_WATERMARK_SETS * 3
+		Watermark, counted in single-axis samples (3 per X/Y/Z set).
 
 	INT1MAP : Configure accelerometer pin interrupt 1
-		0x2A -  write 0b00010000 --> 0x10
-		Maps INT1 pin to the accelerometer's Activity status
+		0x2A -  write 0b00000100 --> 0x04 (ACCEL_USE_FIFO)
+		Maps INT1 pin to FIFO_WATERMARK. INT1 is edge triggered on the STM32, so
+		nothing else can share it or the level could stay high and hide the edge.
+		Without the FIFO: write 0b00000001 --> 0x01, DATA_READY. It clears when the
+		X/Y/Z registers are read, which the DMA read on each edge does.
+		While the MCU sleeps (accel_wake_arm) it is remapped to 0b01000000 --> 0x40,
+		AWAKE, so activity raises it instead.
 
 	INT2MAP : Configure accelerometer pin interrupt 2
 		0x2B - write 0x00
@@ -54,7 +67,6 @@
 extern SPI_HandleTypeDef hspi3;
 extern UART_HandleTypeDef huart3;
 extern TIM_HandleTypeDef htim6;
-extern int overflow;
 
 // Everything you need to write this library is in these documents
 // https://www.analog.com/media/en/technical-documentation/data-sheets/adxl362.pdf
@@ -83,10 +95,37 @@ extern int overflow;
 // HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, const uint8_t *pData, uint16_t Size, uint32_t Timeout)
 // HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout)
 
+// Asynchronous read state. One read runs through the SPI3 queue at a time:
+// async_tx holds the command followed by dummy bytes, async_rx the bytes
+// clocked back.
+static uint8_t async_tx[1 + 2 * 3 * ACCEL_FIFO_MAX_SETS];
+static uint8_t async_rx[1 + 2 * 3 * ACCEL_FIFO_MAX_SETS];
+static uint8_t async_cmd_len;
+static accel_read_cb async_done;
+static Spi_Xfer_t async_xfer;
+static volatile uint8_t async_pending; // INT1 fired while a read was in flight
+static uint8_t async_enabled;
+static volatile uint32_t async_errors;  // reads that failed
+static uint8_t async_retries;           // failed in a row
+
+// Motion gate. sensor_awake mirrors STATUS.AWAKE from the last read;
+// wake_armed is set while INT1 is mapped to AWAKE instead of the data trigger.
+static volatile uint8_t sensor_awake = 1;
+static volatile uint8_t wake_armed;
+
+// Sample ring. ring_head is only written by the producer (DMA completion),
+// ring_tail only by the consumer (frame loop), so neither needs a lock.
+static Accel_Sample_t ring[ACCEL_RING_SIZE];
+static volatile uint16_t ring_head;
+static volatile uint16_t ring_tail;
+static volatile uint32_t ring_dropped;
+static volatile uint32_t last_sample_tick;
+
+static HAL_StatusTypeDef accel_start_read(void);
+
 HAL_StatusTypeDef accel_init(void)
 {
 	
-	char msg[100];
 	print_msg("\n* Accelerometer initializing *\n\n");
 
 	uint8_t device_id = accel_read(0x01);
@@ -96,8 +135,7 @@ HAL_StatusTypeDef accel_init(void)
 
 		// Read failed
 		print_msg("Accelerometer initial read fail\n");
-		sprintf(msg, "Read a value of: 0x%x\n", device_id);
-		print_msg(msg);
+		DLOG(DLOG_ACCEL_DEVICE_ID, device_id);
 
 	}
 	
@@ -106,7 +144,7 @@ HAL_StatusTypeDef accel_init(void)
 	
 	print_msg("Initializing accelerometer registers\n");
 	
-	HAL_GPIO_WritePin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin, GPIO_PIN_RESET); // Set accelerometer CS low
+	LL_GPIO_ResetOutputPin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin); // Set accelerometer CS low
 	HAL_Delay(10);
 	
 	// Accelerometer register initialization via burst write
@@ -116,36 +154,45 @@ HAL_StatusTypeDef accel_init(void)
 	tx_buff[2] = 0x64; // Lower 8'b of Activity Threshold (100 mg threshold)
 	tx_buff[3] = 0;	   // Upper 3'b of Activity Threshold
 	tx_buff[4] = 0;	   // Activity time (8'b)
-	tx_buff[5] = 0;    // Lower 8'b of Inactivity Threshold
-	tx_buff[6] = 0;		 // Upper 3'b of Inactivity Threshold
-	tx_buff[7] = 0;		 // Lower 8'b of Inactivity Time
-	tx_buff[8] = 0;		 // Upper 8'b of Inactivity Time
-	tx_buff[9] = 0x3B; // Activity/Inactivity Control Register
+	tx_buff[5] = ACCEL_INACT_THRESH_MG & 0xFF;        // Lower 8'b of Inactivity Threshold
+	tx_buff[6] = (ACCEL_INACT_THRESH_MG >> 8) & 0x07; // Upper 3'b of Inactivity Threshold
+	tx_buff[7] = ACCEL_INACT_TIME_SAMPLES & 0xFF;     // Lower 8'b of Inactivity Time
+	tx_buff[8] = ACCEL_INACT_TIME_SAMPLES >> 8;       // Upper 8'b of Inactivity Time
+	tx_buff[9] = 0x3F; // Activity/Inactivity Control Register
+#if ACCEL_USE_FIFO
+	tx_buff[10] = 0x02 | (((ACCEL_FIFO_WATERMARK_SETS * 3) >> 8) << 3); // FIFO control: stream mode + AH
+	tx_buff[11] = (ACCEL_FIFO_WATERMARK_SETS * 3) & 0xFF; // FIFO samples (watermark)
+	tx_buff[12] = ACCEL_INT1_DATA_MAP;// INT1 configuration: FIFO watermark
+#else
 	tx_buff[10] = 0;	 // FIFO control
 	tx_buff[11] = 0;	 // FIFO samples
-	tx_buff[12] = 0x10;// INT1 configuration
+	tx_buff[12] = ACCEL_INT1_DATA_MAP;// INT1 configuration: DATA_READY
+#endif
 	tx_buff[13] = 0;	 // INT2 configuration
 	tx_buff[14] = 0x13;	 // Filter control
 	tx_buff[15] = 0x22;	 // Power control
 	
-	HAL_StatusTypeDef write_status = HAL_SPI_Transmit(&hspi3, tx_buff, 16, 1000);
+	HAL_StatusTypeDef write_status = spi_ll_transfer(hspi3.Instance, tx_buff, NULL, 16);
 	
-	HAL_GPIO_WritePin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin, GPIO_PIN_SET); // Set accelerometer CS high
+	LL_GPIO_SetOutputPin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin); // Set accelerometer CS high
 	HAL_Delay(10);
 	
 	uint8_t read_val = accel_read(0x01);
-	sprintf(msg, "Contents of register 0x01 is 0x%x\n", read_val);
-	print_msg(msg);
+	DLOG(DLOG_ACCEL_REG01, read_val);
+
+	// Samples queued during the prints above may already have raised INT1;
+	// read them so it can produce a fresh edge
+	last_sample_tick = HAL_GetTick();
+	async_enabled = 1;
+	accel_start_read();
 	
 	return HAL_OK;
 }
 
 HAL_StatusTypeDef accel_write(uint8_t reg, uint8_t val){
 	
-	char msg[100];
-	sprintf(msg, "Writing 0x%x into register 0x%x\n", val, reg);
-	print_msg(msg);
-	HAL_GPIO_WritePin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin, GPIO_PIN_RESET); // Set accelerometer CS low
+	DLOG(DLOG_ACCEL_WRITE, val, reg);
+	LL_GPIO_ResetOutputPin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin); // Set accelerometer CS low
 	HAL_Delay(10);
 
 	uint8_t tx_buff[3];
@@ -160,18 +207,17 @@ HAL_StatusTypeDef accel_write(uint8_t reg, uint8_t val){
 	rx_buff[2] = val;
 	
 	HAL_StatusTypeDef write_status;
-	write_status = HAL_SPI_TransmitReceive(&hspi3, tx_buff, rx_buff, 3, 1000);
+	write_status = spi_ll_transfer(hspi3.Instance, tx_buff, rx_buff, 3);
 	
-	if (write_status != HAL_OK) print_msg("Write no good\n");
+	if (write_status != HAL_OK) DLOG(DLOG_ACCEL_WRITE_FAIL);
 	
-	print_msg("tx_buff       rx_buff\n");
+	DLOG(DLOG_ACCEL_XFER_HEADER);
 	for (int8_t i = 0; i < 3; i++) {
-		sprintf(msg, "0x%x       0x%x\n", tx_buff[i], rx_buff[i]);
-		print_msg(msg);
+		DLOG(DLOG_ACCEL_XFER_BYTE, tx_buff[i], rx_buff[i]);
 	}
 
 	
-	HAL_GPIO_WritePin(GPIOD, ACCEL_CS_Pin, GPIO_PIN_SET);
+	LL_GPIO_SetOutputPin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin);
 	HAL_Delay(10);
 
 	return write_status;
@@ -181,9 +227,8 @@ HAL_StatusTypeDef accel_write(uint8_t reg, uint8_t val){
 
 int8_t accel_read(int8_t reg)
 {
-	print_msg("Reading\n");
+	DLOG(DLOG_ACCEL_READING);
 
-	char msg[100];
 	
 	uint8_t tx_buff[3];
 	uint8_t rx_buff[3];
@@ -193,12 +238,12 @@ int8_t accel_read(int8_t reg)
 	tx_buff[1] = reg;  // Register we want to read from
 	tx_buff[2] = 0;	   // Dummy byte
 
-	HAL_GPIO_WritePin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin, GPIO_PIN_RESET); // Set accelerometer CS low
+	LL_GPIO_ResetOutputPin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin); // Set accelerometer CS low
 	HAL_Delay(10);
 
-	HAL_StatusTypeDef status = HAL_SPI_TransmitReceive(&hspi3, tx_buff, rx_buff, 3, 1000);
+	HAL_StatusTypeDef status = spi_ll_transfer(hspi3.Instance, tx_buff, rx_buff, 3);
 
-	HAL_GPIO_WritePin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin, GPIO_PIN_SET);
+	LL_GPIO_SetOutputPin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin);
 	HAL_Delay(10);
 	
 	if (status == HAL_OK)
@@ -206,14 +251,12 @@ int8_t accel_read(int8_t reg)
 	else
 		ret_val = -1;
 	
-	print_msg("tx_buff       rx_buff\n");
+	DLOG(DLOG_ACCEL_XFER_HEADER);
 	for (int8_t i = 0; i < 3; i++) {
-		sprintf(msg, "0x%x       0x%x\n", tx_buff[i], rx_buff[i]);
-		print_msg(msg);
+		DLOG(DLOG_ACCEL_XFER_BYTE, tx_buff[i], rx_buff[i]);
 	}
 
-	sprintf(msg, "Read on reg 0x%x returns value 0x%x\n", reg, ret_val);
-	print_msg(msg);
+	DLOG(DLOG_ACCEL_READ, reg, (uint8_t)ret_val);
 	
 
 	
@@ -223,7 +266,6 @@ int8_t accel_read(int8_t reg)
 HAL_StatusTypeDef accel_poll(int16_t *read_buff)
 {
 
-	char msg[100];
 	// Burst reads to read all 6 registers for X, Y, Z accelerometer data
 
 	uint8_t tx_buff[8];
@@ -234,10 +276,10 @@ HAL_StatusTypeDef accel_poll(int16_t *read_buff)
 	for (int8_t i = 2; i < 8; i++)
 		tx_buff[i] = 0; // indices 2, 3, 4 are dummy bytes
 	
-	HAL_GPIO_WritePin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin, GPIO_PIN_RESET); // Set accelerometer CS low
+	LL_GPIO_ResetOutputPin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin); // Set accelerometer CS low
 	//HAL_Delay(10);
 	
-	HAL_StatusTypeDef status = HAL_SPI_TransmitReceive(&hspi3, tx_buff, rx_buff, 8, 1000);
+	HAL_StatusTypeDef status = spi_ll_transfer(hspi3.Instance, tx_buff, rx_buff, 8);
 
 	if (status == HAL_OK)
 	{
@@ -247,15 +289,311 @@ HAL_StatusTypeDef accel_poll(int16_t *read_buff)
 		read_buff[2] = ((int16_t)rx_buff[7] << 8 )| rx_buff[6];
 	}
 	
-	sprintf(msg, "\nX: %d\nY: %d\nZ: %d\n\n", rx_buff[2], rx_buff[3], rx_buff[4]);
-	//print_msg(msg);
 	
-	HAL_GPIO_WritePin(GPIOD, ACCEL_CS_Pin, GPIO_PIN_SET);
+	LL_GPIO_SetOutputPin(ACCEL_CS_GPIO_Port, ACCEL_CS_Pin);
 	//HAL_Delay(10);
 
 	return status;
 }
 
+static void accel_read_finish(Spi_Xfer_t *xfer, HAL_StatusTypeDef status);
+
+// Starts a non-blocking read: queues cmd_len command bytes followed by len
+// dummy bytes on SPI3 and calls done from the DMA completion interrupt.
+// Returns HAL_BUSY if the previous read has not finished.
+HAL_StatusTypeDef accel_read_async(const uint8_t *cmd, uint8_t cmd_len, uint16_t len, accel_read_cb done)
+{
+	if (cmd_len + len > sizeof(async_tx)) return HAL_ERROR;
+
+	// Both the EXTI handler and the main loop start reads, and the buffers
+	// must not change under a read that is still queued
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (async_xfer.state != SPI_XFER_IDLE) {
+		__set_PRIMASK(primask);
+		return HAL_BUSY;
+	}
+
+	memcpy(async_tx, cmd, cmd_len);
+	memset(async_tx + cmd_len, 0, len);
+	async_cmd_len = cmd_len;
+	async_done = done;
+	async_xfer = (Spi_Xfer_t){
+		.cs_port = ACCEL_CS_GPIO_Port, .cs_pin = ACCEL_CS_Pin,
+		.tx = async_tx, .rx = async_rx, .len = cmd_len + len,
+		.done = accel_read_finish,
+	};
+	HAL_StatusTypeDef status = spi_queue_submit(&spi3_queue, &async_xfer);
+	__set_PRIMASK(primask);
+	return status;
+}
+
+// A failed read leaves INT1 high with no edge to come. Have accel_read_finish
+// run the handler again straight away, up to ACCEL_READ_RETRIES times in a
+// row; past that the stall check in accel_ring_pop() picks it up.
+static void accel_read_failed(void)
+{
+	async_errors++;
+	if (++async_retries <= ACCEL_READ_RETRIES) async_pending = 1;
+}
+
+static void accel_read_finish(Spi_Xfer_t *xfer, HAL_StatusTypeDef status)
+{
+	accel_read_cb done = async_done;
+
+	// data is only valid until done starts the next read
+	if (done) {
+		if (status == HAL_OK) done(status, async_rx + async_cmd_len, xfer->len - async_cmd_len);
+		else done(status, NULL, 0);
+	}
+
+	// An INT1 edge arrived mid-transfer: handle it now
+	if (async_pending && async_xfer.state == SPI_XFER_IDLE) {
+		async_pending = 0;
+		accel_int1_handler();
+	}
+}
+
+// Producer side, DMA completion interrupt only. A full ring keeps the older
+// samples and counts the drop. The caller releases the sensor task once the
+// whole read is in, so a FIFO burst is one release rather than one per set.
+static void accel_ring_push(const Accel_Sample_t *sample)
+{
+	uint16_t head = ring_head;
+	uint16_t next = (head + 1) & (ACCEL_RING_SIZE - 1);
+
+	if (next == ring_tail) {
+		ring_dropped++;
+		return;
+	}
+	ring[head] = *sample;
+	__DMB(); // publish the sample before the index
+	ring_head = next;
+	last_sample_tick = HAL_GetTick();
+}
+
+// Consumer side, main loop only. Returns 0 if the ring is empty.
+uint8_t accel_ring_pop(Accel_Sample_t *sample)
+{
+	uint16_t tail = ring_tail;
+
+	if (tail == ring_head) {
+		// An edge missed while INT1 was already high, or a failed transfer,
+		// leaves the sensor waiting to be read; re-arm from here
+		if (async_enabled && HAL_GetTick() - last_sample_tick > ACCEL_STALL_MS) {
+			last_sample_tick = HAL_GetTick();
+			accel_start_read();
+		}
+		return 0;
+	}
+	__DMB(); // read the sample only after seeing the index
+	*sample = ring[tail];
+	__DMB(); // finish reading before handing the slot back
+	ring_tail = (tail + 1) & (ACCEL_RING_SIZE - 1);
+	return 1;
+}
+
+#if ACCEL_USE_FIFO
+// Each FIFO entry is little endian: bits 15:14 tag the axis (0 X, 1 Y, 2 Z,
+// 3 temperature) and bits 13:0 hold the sign extended sample. Sets are pushed
+// when their Z entry completes them.
+static void accel_fifo_data_done(HAL_StatusTypeDef status, const uint8_t *data, uint16_t len)
+{
+	if (status != HAL_OK) {
+		accel_read_failed();
+		return;
+	}
+	async_retries = 0;
+
+	Accel_Sample_t set = {0, 0, 0, 0};
+	uint8_t have = 0;
+	uint8_t sets = len / 6, index = 0;
+	for (uint16_t i = 0; i + 1 < len; i += 2) {
+		uint16_t entry = data[i] | ((uint16_t)data[i + 1] << 8);
+		uint8_t axis = entry >> 14;
+		int16_t val = (int16_t)(entry << 2) >> 2;
+
+		if (axis == 0) {
+			set.x = val;
+			have = 1;
+		} else if (axis == 1) {
+			set.y = val;
+			have |= 2;
+		} else if (axis == 2) {
+			set.z = val;
+			if (have == 3) {
+#if M2P_ENABLE
+				set.stamp = m2p_sample_stamp(index, sets, ACCEL_ODR_HZ);
+#endif
+				accel_ring_push(&set);
+			}
+			have = 0;
+			index++;
+		}
+	}
+	sched_signal(SCHED_TASK_SENSOR);
+}
+
+// STATUS, FIFO_ENTRIES_L and FIFO_ENTRIES_H arrived; chain the burst read
+// (instruction 0x0D) of every complete set. Leaving fewer than a set behind
+// drops INT1 again.
+static void accel_fifo_entries_done(HAL_StatusTypeDef status, const uint8_t *data, uint16_t len)
+{
+	static const uint8_t cmd[1] = {0x0D};
+
+	(void)len;
+	if (status != HAL_OK) {
+		accel_read_failed();
+		return;
+	}
+	async_retries = 0;
+
+	sensor_awake = (data[0] & ACCEL_STATUS_AWAKE) != 0;
+	uint16_t entries = data[1] | ((uint16_t)(data[2] & 0x03) << 8);
+	if (entries > 3 * ACCEL_FIFO_MAX_SETS) entries = 3 * ACCEL_FIFO_MAX_SETS;
+	entries -= entries % 3; // whole sets only, so the next read stays aligned
+	if (entries == 0) return;
+
+	accel_read_async(cmd, 1, 2 * entries, accel_fifo_data_done);
+}
+#else
+// STATUS through ZDATA_H, read on DATA_READY. XDATA_L is at data[3], after
+// STATUS and the two FIFO_ENTRIES registers.
+static void accel_xyz_done(HAL_StatusTypeDef status, const uint8_t *data, uint16_t len)
+{
+	(void)len;
+	if (status != HAL_OK) {
+		accel_read_failed();
+		return;
+	}
+	async_retries = 0;
+
+	sensor_awake = (data[0] & ACCEL_STATUS_AWAKE) != 0;
+	Accel_Sample_t set;
+	set.x = ((int16_t)data[4] << 8) | data[3];
+	set.y = ((int16_t)data[6] << 8) | data[5];
+	set.z = ((int16_t)data[8] << 8) | data[7];
+#if M2P_ENABLE
+	set.stamp = m2p_sample_stamp(0, 1, ACCEL_ODR_HZ);
+#else
+	set.stamp = 0;
+#endif
+	accel_ring_push(&set);
+	sched_signal(SCHED_TASK_SENSOR);
+}
+#endif
+
+static HAL_StatusTypeDef accel_start_read(void)
+{
+	// Both reads start at STATUS (0x0B) to track AWAKE for free
+#if ACCEL_USE_FIFO
+	static const uint8_t cmd[2] = {0x0B, 0x0B};
+	return accel_read_async(cmd, 2, 3, accel_fifo_entries_done);
+#else
+	static const uint8_t cmd[2] = {0x0B, 0x0B};
+	return accel_read_async(cmd, 2, 9, accel_xyz_done);
+#endif
+}
+
+// INT1 mapped back to the data trigger; pick up what queued meanwhile. If
+// the remap failed, INT1 still means AWAKE: arm again so the retry redoes it.
+static void accel_wake_disarmed(HAL_StatusTypeDef status, const uint8_t *data, uint16_t len)
+{
+	(void)data;
+	(void)len;
+	if (status != HAL_OK) {
+		wake_armed = 1;
+		accel_read_failed();
+		return;
+	}
+	async_retries = 0;
+	accel_start_read();
+}
+
+// INT1 edge, from the EXTI handler
+void accel_int1_handler(void)
+{
+	static const uint8_t data_map[3] = {0x0A, 0x2A, ACCEL_INT1_DATA_MAP};
+
+	if (!async_enabled) return;
+
+	HAL_StatusTypeDef status;
+	if (wake_armed) {
+		// Activity while the MCU sleeps: restore the data trigger
+		sensor_awake = 1;
+		status = accel_read_async(data_map, 3, 0, accel_wake_disarmed);
+		if (status == HAL_OK) wake_armed = 0;
+	} else {
+		status = accel_start_read();
+	}
+	if (status == HAL_BUSY) async_pending = 1;
+}
+
+// STATUS read right after INT1 was mapped to AWAKE. Activity that started
+// before the remap never makes an edge, so look for it here.
+static void accel_wake_status_done(HAL_StatusTypeDef status, const uint8_t *data, uint16_t len)
+{
+	(void)len;
+	if (status != HAL_OK || (data[0] & ACCEL_STATUS_AWAKE)) accel_int1_handler();
+}
+
+static void accel_wake_mapped(HAL_StatusTypeDef status, const uint8_t *data, uint16_t len)
+{
+	static const uint8_t cmd[2] = {0x0B, 0x0B};
+
+	(void)data;
+	(void)len;
+	if (status != HAL_OK || accel_read_async(cmd, 2, 1, accel_wake_status_done) != HAL_OK)
+		accel_int1_handler(); // could not arm, wake straight back up
+}
+
+// Last STATUS.AWAKE seen: 0 once the inactivity timer has expired, 1 again
+// after activity
+uint8_t accel_awake(void)
+{
+	return sensor_awake;
+}
+
+// Maps INT1 to AWAKE so the next activity event interrupts a sleeping MCU.
+// Returns HAL_BUSY while a read is in flight; call again. accel_awake() goes
+// back to 1 when the device moves, and INT1 returns to the data trigger.
+HAL_StatusTypeDef accel_wake_arm(void)
+{
+	static const uint8_t wake_map[3] = {0x0A, 0x2A, 0x40};
+
+	if (!async_enabled) return HAL_ERROR;
+
+	wake_armed = 1;
+	HAL_StatusTypeDef status = accel_read_async(wake_map, 3, 0, accel_wake_mapped);
+	if (status == HAL_OK)
+		async_pending = 0; // data trigger edges from before the remap
+	else
+		wake_armed = 0;
+	return status;
+}
+
+// Empties the ring into read_buff (x, y, z) as the average of every queued
+// set and returns how many there were; read_buff is untouched if none.
+uint16_t accel_ring_average(int16_t *read_buff)
+{
+	int32_t sum[3] = {0, 0, 0};
+	uint16_t count = 0;
+	Accel_Sample_t sample;
+	while (accel_ring_pop(&sample)) {
+		sum[0] += sample.x;
+		sum[1] += sample.y;
+		sum[2] += sample.z;
+		count++;
+	}
+
+	if (count) {
+		read_buff[0] = sum[0] / count;
+		read_buff[1] = sum[1] / count;
+		read_buff[2] = sum[2] / count;
+	}
+	return count;
+}
+
 /* Tried initializing registers with a burst write.
 
 	tx_buff[0] = 0x0A; // Write instruction
@@ -268,9 +606,15 @@ HAL_StatusTypeDef accel_poll(int16_t *read_buff)
 	tx_buff[7] = 0;		 // Lower 8'b of Inactivity Time
 	tx_buff[8] = 0;		 // Upper 8'b of Inactivity Time
 	tx_buff[9] = 0x3B; // Activity/Inactivity Control Register
+#if ACCEL_USE_FIFO
+	tx_buff[10] = 0x02 | (((ACCEL_FIFO_WATERMARK_SETS * 3) >> 8) << 3); // FIFO control: stream mode + AH
+	tx_buff[11] = (ACCEL_FIFO_WATERMARK_SETS * 3) & 0xFF; // FIFO samples (watermark)
+	tx_buff[12] = 0x04;// INT1 configuration: FIFO watermark
+#else
 	tx_buff[10] = 0;	 // FIFO control
 	tx_buff[11] = 0;	 // FIFO samples
-	tx_buff[12] = 0x10;// INT1 configuration
+	tx_buff[12] = 0x01;// INT1 configuration: DATA_READY
+#endif
 	tx_buff[13] = 0;	 // INT2 configuration
 	tx_buff[14] = 0x13;	 // Filter control
 	tx_buff[15] = 0x12;	 // Power control
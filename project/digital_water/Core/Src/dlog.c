@@ -0,0 +1,134 @@
+#include "dlog.h"
+
+extern UART_HandleTypeDef huart3;
+
+// Byte ring drained by USART3 DMA. Writers append at dlog_head with
+// interrupts masked (both the main loop and interrupts log); the UART
+// completion interrupt advances dlog_tail past each span it sent.
+static uint8_t dlog_ring[DLOG_RING_SIZE];
+static volatile uint16_t dlog_head;
+static volatile uint16_t dlog_tail;
+static volatile uint16_t dlog_tx_len;   // bytes on the UART, 0 if idle
+static volatile uint32_t dlog_dropped;  // records lost since the last report
+
+#define DLOG_MASK (DLOG_RING_SIZE - 1)
+
+static uint16_t dlog_free(void)
+{
+  return (dlog_tail - dlog_head - 1) & DLOG_MASK;
+}
+
+static void dlog_put(const uint8_t *src, uint16_t len)
+{
+  uint16_t head = dlog_head;
+  uint16_t first = DLOG_RING_SIZE - head;
+
+  if (first > len) first = len;
+  memcpy(&dlog_ring[head], src, first);
+  memcpy(dlog_ring, src + first, len - first);
+  dlog_head = (head + len) & DLOG_MASK;
+}
+
+// Sends the oldest contiguous span if the UART is free. Called with
+// interrupts masked or from the UART interrupt.
+static void dlog_kick(void)
+{
+  uint16_t head = dlog_head;
+  uint16_t tail = dlog_tail;
+
+  if (dlog_tx_len || head == tail) return;
+
+  uint16_t len = head > tail ? head - tail : DLOG_RING_SIZE - tail;
+  // Someone else (testPrint) may own the UART; its completion kicks us again
+  if (HAL_UART_Transmit_DMA(&huart3, &dlog_ring[tail], len) == HAL_OK)
+    dlog_tx_len = len;
+}
+
+static void dlog_commit(const uint8_t *record, uint16_t len)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  if (dlog_dropped && dlog_free() >= 7 + len) {
+    uint8_t report[7] = {DLOG_SYNC, DLOG_ID_DROPPED, 1};
+    uint32_t dropped = dlog_dropped;
+    memcpy(&report[3], &dropped, sizeof(dropped));
+    dlog_put(report, sizeof(report));
+    dlog_dropped = 0;
+  }
+
+  if (dlog_free() >= len) dlog_put(record, len);
+  else dlog_dropped++;
+
+  dlog_kick();
+  __set_PRIMASK(primask);
+}
+
+// Queues bytes verbatim, for other framed protocols sharing the UART
+// (telemetry). Dropped whole if they do not fit.
+void dlog_raw(const uint8_t *data, uint16_t len)
+{
+  dlog_commit(data, len);
+}
+
+// Use through DLOG(). Every argument is read as 32 bits, so floats must go
+// through DLOG_F() rather than be promoted to double.
+void dlog_write(uint8_t nargs, uint8_t id, ...)
+{
+  uint8_t record[3 + 4 * DLOG_MAX_ARGS];
+  va_list args;
+
+  if (nargs > DLOG_MAX_ARGS) nargs = DLOG_MAX_ARGS;
+  record[0] = DLOG_SYNC;
+  record[1] = id;
+  record[2] = nargs;
+
+  va_start(args, id);
+  for (uint8_t i = 0; i < nargs; i++) {
+    uint32_t value = va_arg(args, uint32_t);
+    memcpy(&record[3 + 4 * i], &value, sizeof(value));
+  }
+  va_end(args);
+
+  dlog_commit(record, 3 + 4 * nargs);
+}
+
+// Already formatted text, split into records of up to 255 bytes
+void dlog_text(const char *text)
+{
+  uint8_t record[3 + 255];
+  size_t len = strlen(text);
+
+  while (len) {
+    uint8_t chunk = len > 255 ? 255 : len;
+    record[0] = DLOG_SYNC;
+    record[1] = DLOG_ID_TEXT;
+    record[2] = chunk;
+    memcpy(&record[3], text, chunk);
+    dlog_commit(record, 3 + chunk);
+    text += chunk;
+    len -= chunk;
+  }
+}
+
+// Waits until everything logged so far is on the wire
+void dlog_flush(void)
+{
+  while (dlog_head != dlog_tail) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    dlog_kick();
+    __set_PRIMASK(primask);
+  }
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+  if (huart != &huart3) return;
+
+  if (dlog_tx_len) {
+    dlog_tail = (dlog_tail + dlog_tx_len) & DLOG_MASK;
+    dlog_tx_len = 0;
+  }
+  dlog_kick();
+}
@@ -1,6 +1,9 @@
 #include "fluid_sim.h"
 #include "physics.h"
 #include "oled.h"
+#include "dlog.h"
+#include "usb_cdc.h"
+#include "prof.h"
 
 // FLUID SIM Initializations
 /*
@@ -130,12 +133,14 @@ void Sim_Particle_Step() {
   }
 }
 
+uint8_t sim_separate_iterations = SIM_PARTICLE_SEPARATE_ITERATIONS;
+uint8_t sim_grid_iterations = SIM_GRID_ITERATIONS;
 
 void Sim_Particle_PushParticlesApart() {
   // reset particle_count for all cells
   // print_msg("reset particle counts\n");
-  for (int separate_iter = 0; separate_iter < SIM_PARTICLE_SEPARATE_ITERATIONS;
-       separate_iter++) {
+  int passes = sim_separate_iterations ? sim_separate_iterations : 1;
+  for (int separate_iter = 0; separate_iter < passes; separate_iter++) {
 
     // reset grid particle count and linked list
     for (int k = 0; k < SIM_PHYS_X_SIZE; k++) {
@@ -173,7 +178,7 @@ void Sim_Particle_PushParticlesApart() {
     int split_count = 0;
     for (int x = 0; x < SIM_PHYS_X_SIZE; x++) {
       for (int y = 0; y < SIM_PHYS_Y_SIZE; y++) {
-        if (grid_array[x][y].particle_count > 1) {
+        if (sim_separate_iterations && grid_array[x][y].particle_count > 1) {
           // more than one particle, separate ALL particles in cell
           Sim_Particle_t *focusParticle = grid_array[x][y].head;
           Sim_Particle_t *otherParticle = NULL;
@@ -509,160 +514,520 @@ void Sim_TransferVelocities(int toGrid) {
   }
 }
 
+// Particle positions before the latest step, in cells with 8 fractional bits
+// (16 bits a coordinate rather than a float: this is 6 KB as it is)
+static int16_t prev_pos[SIM_PARTICLE_COUNT][2];
+
+static void Sim_SavePositions() {
+  for (int k = 0; k < SIM_PARTICLE_COUNT; k++) {
+    prev_pos[k][0] = (int16_t)(particle_array[k].position.x * 256);
+    prev_pos[k][1] = (int16_t)(particle_array[k].position.y * 256);
+  }
+}
+
 void Sim_Physics_Step() {
   //print_msg("physics step\n");
+  Sim_SavePositions();
   for (int k = 0; k < SIM_ITERATIONS; k++) {
     //print_msg("particle step\n");
+    PROF_BEGIN(PROF_SIM_PARTICLE_STEP);
     Sim_Particle_Step(); // handle particle movement + gravity
+    PROF_END(PROF_SIM_PARTICLE_STEP);
 
     // print_msg("pushed particles apart\n");
+    PROF_BEGIN(PROF_SIM_PUSH_APART);
     Sim_Particle_PushParticlesApart(); // separate particles from each other
+    PROF_END(PROF_SIM_PUSH_APART);
 
     // print_msg("particle -> grid velocity transfer\n");
+    PROF_BEGIN(PROF_SIM_TO_GRID);
     Sim_TransferVelocities(1); // transfer particle -> grid velocities
+    PROF_END(PROF_SIM_TO_GRID);
 
     // update particle density?
     //print_msg("grid solver\n");
-    Sim_Grid_Step(); // solve incompressibility
+    PROF_BEGIN(PROF_SIM_GRID_STEP);
+    for (int g = 0; g < sim_grid_iterations; g++) {
+      Sim_Grid_Step(); // solve incompressibility
+    }
+    PROF_END(PROF_SIM_GRID_STEP);
 
     // print_msg("grid -> particle velocity transfer\n");
+    PROF_BEGIN(PROF_SIM_TO_PARTICLES);
     Sim_TransferVelocities(0); // transfer grid -> particle velocities
+    PROF_END(PROF_SIM_TO_PARTICLES);
   }
 }
 
 void Sim_Physics_Init() {
   Sim_Grid_Init();
   Sim_Particle_Init();
+  Sim_SavePositions();
+}
+
+// 1 once the mean squared particle speed drops below SIM_SETTLED_SPEED^2, so
+// stopping the simulation would not freeze visible motion
+uint8_t Sim_Settled() {
+  float speed_squared = 0;
+  for (int k = 0; k < SIM_PARTICLE_COUNT; k++) {
+    Vec2_t velocity = particle_array[k].velocity;
+    speed_squared += velocity.x * velocity.x + velocity.y * velocity.y;
+  }
+  return speed_squared <
+         SIM_SETTLED_SPEED * SIM_SETTLED_SPEED * SIM_PARTICLE_COUNT;
+}
+
+// Mean and largest particle speed, in cells per second (for telemetry)
+void Sim_ParticleSpeeds(float *mean, float *max) {
+  float sum = 0, max_squared = 0;
+  for (int k = 0; k < SIM_PARTICLE_COUNT; k++) {
+    Vec2_t velocity = particle_array[k].velocity;
+    float speed_squared = velocity.x * velocity.x + velocity.y * velocity.y;
+    sum += sqrtf(speed_squared);
+    if (speed_squared > max_squared) max_squared = speed_squared;
+  }
+  *mean = sum / SIM_PARTICLE_COUNT;
+  *max = sqrtf(max_squared);
 }
 
 // FOR SERIAL MONITOR USE:
-extern uint16_t image_buff[SIM_RENDER_X_SIZE * SIM_RENDER_Y_SIZE];
 extern uint8_t tx_buff[sizeof(PREAMBLE) +
-                       SIM_RENDER_X_SIZE * SIM_RENDER_Y_SIZE + sizeof(SUFFIX) +
-                      2];
+                       SIM_RENDER_X_SIZE * SIM_RENDER_Y_SIZE + sizeof(SUFFIX)];
 extern size_t tx_buff_len;
 extern UART_HandleTypeDef huart3;
 
-void renderImage() {
-  for (int k = 0; k < SIM_RENDER_X_SIZE * SIM_RENDER_Y_SIZE; k++) {
-    image_buff[k] = BLACK; // Background color
+#if SIM_RENDER_X_SIZE != RGB_OLED_WIDTH || SIM_RENDER_Y_SIZE != RGB_OLED_HEIGHT
+#error "render size must match the OLED for band streaming"
+#endif
+
+// Particles binned by screen row. Row y owns the entries
+// row_pos[row_start[y]] .. row_pos[row_start[y + 1] - 1], each holding the
+// particle's sub-pixel screen x and its sub-pixel phase within the row (see
+// ROW_POS_X / ROW_POS_Y_PHASE).
+// Built by renderImage() and read by renderBand() from the SPI1 DMA interrupt,
+// so it must not be rebuilt while oled_frame_busy().
+static uint16_t row_start[SIM_RENDER_Y_SIZE + 1];
+static uint16_t row_pos[SIM_PARTICLE_COUNT];
+static uint8_t render_oob; // some particle was outside the grid this frame
+static uint8_t row_scratch[SIM_RENDER_X_SIZE];
+
+// Scalar density field for the surface renderer, one node per grid cell
+// centre. Copied out of grid_array by renderImage() so physics can run while
+// the frame streams.
+static uint8_t density_field[SIM_PHYS_X_SIZE][SIM_PHYS_Y_SIZE];
+
+// Palette index of each cell's water colour, quantised from its mean speed and
+// particle count by renderImage()
+static uint8_t cell_shade[SIM_PHYS_X_SIZE][SIM_PHYS_Y_SIZE];
+
+typedef char sim_side_bytes_check[sizeof(prev_pos[0]) + sizeof(row_pos[0]) == SIM_PARTICLE_SIDE_BYTES &&
+                                  sizeof(density_field[0][0]) + sizeof(cell_shade[0][0]) == SIM_CELL_SIDE_BYTES
+                                  ? 1 : -1];
+
+uint8_t sim_render_mode = SIM_RENDER_MODE_DEFAULT;
+uint8_t sim_render_degraded;
+static uint8_t frame_render_mode; // mode latched for the frame in flight
+
+// Screen positions carry SIM_SPLAT_SUBPIXEL_BITS fractional bits
+#define SUBPIXEL_ONE (1 << SIM_SPLAT_SUBPIXEL_BITS)
+#define SUBPIXEL_MASK (SUBPIXEL_ONE - 1)
+#define ROW_POS(x_q, y_q) (((x_q) << SIM_SPLAT_SUBPIXEL_BITS) | ((y_q) & SUBPIXEL_MASK))
+#define ROW_POS_X(pos) ((pos) >> SIM_SPLAT_SUBPIXEL_BITS)
+#define ROW_POS_Y_PHASE(pos) ((pos) & SUBPIXEL_MASK)
+
+float sim_render_alpha = 1;
+
+// Screen position from a position in cells with 8 fractional bits
+static int screenRowQ(int y_q8) {
+  int screen_y = ((SIM_RENDER_TO_PHYS_RATIO * SUBPIXEL_ONE) *
+                  ((SIM_PHYS_Y_SIZE << 8) - y_q8)) >> 8;
+  if (screen_y < 0) {
+    screen_y = 0;
+  } else if (screen_y > (SIM_RENDER_Y_SIZE << SIM_SPLAT_SUBPIXEL_BITS) - 1) {
+    screen_y = (SIM_RENDER_Y_SIZE << SIM_SPLAT_SUBPIXEL_BITS) - 1;
   }
-  /*
-for (int k = 0; k < SIM_PHYS_X_SIZE; k++) {
-  for (int j = 0; j < SIM_PHYS_Y_SIZE; j++) {
-    uint8_t pixel = 0;
-    if (grid_array[j][k].state == SIM_WATER) {
-      pixel = WATER_COLOR_R;
-    } else {
-      pixel = AIR_COLOR_R;
-    }
+  return screen_y;
+}
 
-    image_buff[2 * k][2 * j] = pixel;
-    image_buff[(2 * k) + 1][2 * j] = pixel;
-    image_buff[2 * k][(2 * j) + 1] = pixel;
-    image_buff[(2 * k) + 1][(2 * k) + 1] = pixel;
+static int screenColQ(int x_q8) {
+  int screen_x = ((SIM_RENDER_TO_PHYS_RATIO * SUBPIXEL_ONE) * x_q8) >> 8;
+  if (screen_x < 0) {
+    screen_x = 0;
+  } else if (screen_x > (SIM_RENDER_X_SIZE << SIM_SPLAT_SUBPIXEL_BITS) - 1) {
+    screen_x = (SIM_RENDER_X_SIZE << SIM_SPLAT_SUBPIXEL_BITS) - 1;
   }
+  return screen_x;
 }
-  */
 
-  // iterating by particles
+// Splat kernel
+// One row of taps per sub-pixel phase. Tap t covers the pixel offset
+// t - SIM_SPLAT_RADIUS from the particle's pixel; u is the distance from that
+// pixel's centre to the particle in 1/256 pixel. The 2D weight is the product
+// of the x and y taps (separable kernel), all evaluated at compile time.
+#define SPLAT_TAPS (2 * SIM_SPLAT_RADIUS + 1)
+#define SPLAT_MAX_TAPS 7
+#define SPLAT_MAX_PHASES 8
+#define SPLAT_HALF_WIDTH ((2 * SIM_SPLAT_RADIUS + 1) * 128)
+#define SPLAT_ABS(v) ((v) < 0 ? -(v) : (v))
+#define SPLAT_U(p, t)                                                          \
+  (((t) - SIM_SPLAT_RADIUS) * 256 + 128 -                                      \
+   ((p) << (8 - SIM_SPLAT_SUBPIXEL_BITS)))
+
+#if SIM_SPLAT_KERNEL == SIM_SPLAT_TENT
+#define SPLAT_K(u)                                                             \
+  (SPLAT_ABS(u) >= SPLAT_HALF_WIDTH                                            \
+       ? 0                                                                     \
+       : 255 - (255 * SPLAT_ABS(u)) / SPLAT_HALF_WIDTH)
+#else
+#define SPLAT_K(u) (SPLAT_ABS(u) < SPLAT_HALF_WIDTH ? 255 : 0)
+#endif
+
+#define SPLAT_TAP(p, t) ((t) < SPLAT_TAPS ? SPLAT_K(SPLAT_U(p, t)) : 0)
+#define SPLAT_ROW(p)                                                           \
+  {SPLAT_TAP(p, 0), SPLAT_TAP(p, 1), SPLAT_TAP(p, 2), SPLAT_TAP(p, 3),         \
+   SPLAT_TAP(p, 4), SPLAT_TAP(p, 5), SPLAT_TAP(p, 6)}
+
+#if SIM_SPLAT_RADIUS < 1 || SPLAT_TAPS > SPLAT_MAX_TAPS
+#error "SIM_SPLAT_RADIUS must be between 1 and 3"
+#endif
+#if SIM_SPLAT_SUBPIXEL_BITS > 3
+#error "SIM_SPLAT_SUBPIXEL_BITS must be at most 3"
+#endif
+
+static const uint8_t splat_kernel[SPLAT_MAX_PHASES][SPLAT_MAX_TAPS] = {
+    SPLAT_ROW(0), SPLAT_ROW(1), SPLAT_ROW(2), SPLAT_ROW(3),
+    SPLAT_ROW(4), SPLAT_ROW(5), SPLAT_ROW(6), SPLAT_ROW(7),
+};
+
+// Coverage for the band being rendered
+static uint16_t splat_accum[OLED_BAND_PIXELS];
+
+// Particle k's position sim_render_alpha of the way through the latest step.
+// The only float -> fixed conversion in the render path.
+static void renderLerpPosition(int k, int alpha_q8, int *x_q8, int *y_q8) {
+  int x0 = prev_pos[k][0];
+  int y0 = prev_pos[k][1];
+  int x1 = (int)(particle_array[k].position.x * 256);
+  int y1 = (int)(particle_array[k].position.y * 256);
+  *x_q8 = x0 + (((x1 - x0) * alpha_q8) >> 8);
+  *y_q8 = y0 + (((y1 - y0) * alpha_q8) >> 8);
+}
 
-  for (int k = 0; k < SIM_PARTICLE_COUNT; k++) {
-    Sim_Cell_t *locatedCell = GetCellFromPosition(particle_array[k].position);
-    if (locatedCell) {
-      uint8_t pixel = WATER_COLOR_R;
-
-    int screen_x = SIM_RENDER_TO_PHYS_RATIO * particle_array[k].position.x;
-    int screen_y = SIM_RENDER_TO_PHYS_RATIO *
-                   (SIM_PHYS_Y_SIZE - particle_array[k].position.y);
-    if (screen_y < 0) {
-      screen_y = 0;
-    } else if (screen_y > SIM_RENDER_Y_SIZE - 1) {
-      screen_y = SIM_RENDER_Y_SIZE - 1;
-    }
-    if (screen_x < 0) {
-      screen_x = 0;
-    } else if (screen_x > SIM_RENDER_X_SIZE - 1) {
-      screen_x = SIM_RENDER_X_SIZE - 1;
-    }
-    image_buff[(screen_y * SIM_RENDER_X_SIZE) + (screen_x)] = pixel;
-    // image_buff[(screen_y * SIM_RENDER_X_SIZE) + (screen_x + 1)] = pixel;
-    // image_buff[((screen_y + 1) * SIM_RENDER_X_SIZE) + (screen_x)] = pixel;
-    // image_buff[((screen_y + 1) * SIM_RENDER_X_SIZE) + (screen_x + 1)] =
-    // pixel;
+static void renderBinParticles(void) {
+  uint16_t row_fill[SIM_RENDER_Y_SIZE];
+  int alpha_q8 = (int)(sim_render_alpha * 256);
+  int x_q8, y_q8;
+  memset(row_start, 0, sizeof(row_start));
+  render_oob = 0;
 
-      // sprintf(msg, "%d: (%d, %d) vs (%f, %f)\n", k, x, y,
+  // count particles per row, offset by one for the prefix sum
+  for (int k = 0; k < SIM_PARTICLE_COUNT; k++) {
+    if (GetCellFromPosition(particle_array[k].position) == NULL) {
+      // sprintf(msg, "renderImage(), OOB: %d: (%f, %f)\n", k,
       //         particle_array[k].position.x, particle_array[k].position.y);
       // print_msg(msg);
+      render_oob = 1;
+      continue;
+    }
+    renderLerpPosition(k, alpha_q8, &x_q8, &y_q8);
+    row_start[(screenRowQ(y_q8) >> SIM_SPLAT_SUBPIXEL_BITS) + 1]++;
+  }
 
-    } else {
-      sprintf(msg, "renderImage(), OOB: %d: (%f, %f)\n", k,
-              particle_array[k].position.x, particle_array[k].position.y);
-     // print_msg(msg);
-      image_buff[0] = SOLID_COLOR_B;
-      image_buff[1] = SOLID_COLOR_B;
+  for (int y = 0; y < SIM_RENDER_Y_SIZE; y++) {
+    row_start[y + 1] += row_start[y];
+    row_fill[y] = row_start[y];
+  }
+
+  // scatter each particle's column into its row's bin
+  for (int k = 0; k < SIM_PARTICLE_COUNT; k++) {
+    if (GetCellFromPosition(particle_array[k].position) == NULL) {
+      continue;
     }
+    renderLerpPosition(k, alpha_q8, &x_q8, &y_q8);
+    int screen_y = screenRowQ(y_q8);
+    row_pos[row_fill[screen_y >> SIM_SPLAT_SUBPIXEL_BITS]++] =
+        ROW_POS(screenColQ(x_q8), screen_y);
   }
+}
 
-  // iterating by cell (not as functional?)
-  /*
+static void renderBuildDensityField(void) {
+  // particle_count is left up to date by the particle -> grid transfer
   for (int x = 0; x < SIM_PHYS_X_SIZE; x++) {
     for (int y = 0; y < SIM_PHYS_Y_SIZE; y++) {
-      uint8_t pixel = AIR_COLOR_B;
+      int density = grid_array[x][y].particle_count * SIM_SURFACE_SCALE;
+      density_field[x][y] = density > 255 ? 255 : density;
+    }
+  }
+}
 
-      if (grid_array[x][y].state == SIM_SOLID) {
-        pixel = SOLID_COLOR_B;
-      } else if (grid_array[x][y].state == SIM_WATER) {
-        pixel = WATER_COLOR_B;
+// Per-cell work only; the per-pixel paths just index cell_shade
+static void renderBuildShadeField(void) {
+  const float step_squared = SIM_SHADE_SPEED_STEP * SIM_SHADE_SPEED_STEP;
+  for (int x = 0; x < SIM_PHYS_X_SIZE; x++) {
+    for (int y = 0; y < SIM_PHYS_Y_SIZE; y++) {
+      int count = grid_array[x][y].particle_count;
+      int density = count / SIM_SHADE_DENSITY_STEP;
+      if (density > SIM_SHADE_DENSITY_LEVELS - 1) {
+        density = SIM_SHADE_DENSITY_LEVELS - 1;
       }
-      int screen_x = 2 * x;
-      int screen_y = 2 * (SIM_PHYS_Y_SIZE - y);
-      if (screen_y < 0) {
-        screen_y = 0;
-      } else if (screen_y > SIM_RENDER_Y_SIZE - 1) {
-        screen_y = SIM_RENDER_Y_SIZE - 2;
+
+      // cell velocity is the sum over its particles, so compare
+      // |sum|^2 against (level * step * count)^2 rather than dividing
+      Vec2_t velocity = grid_array[x][y].velocity;
+      float speed_squared = velocity.x * velocity.x + velocity.y * velocity.y;
+      float count_squared = (float)(count * count);
+      int speed = 0;
+      while (speed < SIM_SHADE_SPEED_LEVELS - 1 &&
+             speed_squared >= (speed + 1) * (speed + 1) * step_squared *
+                                  count_squared) {
+        speed++;
       }
-      image_buff[(screen_y)*SIM_RENDER_X_SIZE + (screen_x)] = pixel;
-      image_buff[(screen_y)*SIM_RENDER_X_SIZE + (screen_x + 1)] = pixel;
-      image_buff[((screen_y + 1) * SIM_RENDER_X_SIZE) + (screen_x)] = pixel;
-      image_buff[((screen_y + 1) * SIM_RENDER_X_SIZE) + (screen_x + 1)] = pixel;
+
+      cell_shade[x][y] = SIM_PAL_SHADE_BASE + SIM_SHADE_INDEX(speed, density);
     }
   }
-  */
+}
+
+void renderImage() {
+  // The previous frame may still be streaming out of the render state
+  while (oled_frame_busy()) {
+  }
+
+  frame_render_mode =
+      sim_render_degraded ? SIM_RENDER_PARTICLES : sim_render_mode;
+#if SIM_SHADE_WATER
+  renderBuildShadeField();
+#endif
+  if (frame_render_mode == SIM_RENDER_SURFACE) {
+    renderBuildDensityField();
+  } else {
+    renderBinParticles();
+  }
   // print_msg("finished renderImage() call\n");
 }
 
-void dummyImage() {
+// Shade of the cell under a sub-pixel screen position (the inverse of
+// screenColQ / screenRowQ, rounded to the nearest cell like
+// GetCellFromPosition)
+static uint8_t renderShadeAt(int x_q, int y_q) {
+  const int cell_q = SIM_RENDER_TO_PHYS_RATIO * SUBPIXEL_ONE;
+  int x = (x_q + cell_q / 2) / cell_q;
+  int y = ((SIM_PHYS_Y_SIZE * cell_q) - y_q + cell_q / 2) / cell_q;
+  if (x > SIM_PHYS_X_SIZE - 1) {
+    x = SIM_PHYS_X_SIZE - 1;
+  }
+  if (y > SIM_PHYS_Y_SIZE - 1) {
+    y = SIM_PHYS_Y_SIZE - 1;
+  }
+  return cell_shade[x][y];
+}
 
-  for (int k = 0; k < SIM_RENDER_X_SIZE * SIM_RENDER_Y_SIZE; k++) {
-    image_buff[k] = AIR_COLOR_R;
+// Palette indices for one screen row, from the bins built by renderImage()
+static void renderParticleRowIndices(int y, uint8_t *dst) {
+  memset(dst, SIM_PAL_BACKGROUND, SIM_RENDER_X_SIZE); // Background color
+  for (int k = row_start[y]; k < row_start[y + 1]; k++) {
+    int x_q = ROW_POS_X(row_pos[k]);
+#if SIM_SHADE_WATER
+    int y_q = (y << SIM_SPLAT_SUBPIXEL_BITS) | ROW_POS_Y_PHASE(row_pos[k]);
+    dst[x_q >> SIM_SPLAT_SUBPIXEL_BITS] = renderShadeAt(x_q, y_q);
+#else
+    dst[x_q >> SIM_SPLAT_SUBPIXEL_BITS] = SIM_PAL_WATER;
+#endif
+  }
+  if (y == 0 && render_oob) {
+    dst[0] = SIM_PAL_SOLID;
+    dst[1] = SIM_PAL_SOLID;
   }
+}
 
-  uint8_t pixel = WATER_COLOR_R;
+// Marching squares over density_field for one screen row. Each square spans
+// SIM_RENDER_TO_PHYS_RATIO pixels between two field nodes; squares with all
+// four corners inside (or outside) the surface are filled as spans, and only
+// squares the contour crosses are interpolated per pixel. Fixed point, 8
+// fractional bits.
+static void renderSurfaceRowIndices(int y, uint8_t *dst) {
+  const int ratio = SIM_RENDER_TO_PHYS_RATIO;
+
+  // physics y of the pixel centre, clamped to the outermost nodes
+  int fy = (SIM_PHYS_Y_SIZE << 8) - (((2 * y + 1) << 8) / (2 * ratio));
+  if (fy < 0) {
+    fy = 0;
+  } else if (fy > (SIM_PHYS_Y_SIZE - 1) << 8) {
+    fy = (SIM_PHYS_Y_SIZE - 1) << 8;
+  }
+  int j0 = fy >> 8;
+  int j1 = j0 < SIM_PHYS_Y_SIZE - 1 ? j0 + 1 : j0;
+  int wy = fy & 0xFF;
+  int j_near = wy < 128 ? j0 : j1;
 
-  for (int k = 0; k < SIM_PHYS_X_SIZE; k++) {
-    for (int j = 0; j < SIM_PHYS_Y_SIZE; j++) {
-      if (k % 2 || j % 2) {
-        pixel = WATER_COLOR_R;
-      } else {
-        pixel = SOLID_COLOR_R;
+  // field interpolated down the left edge of the current square, plus which
+  // of its two corners are inside the surface
+  int left = (density_field[0][j0] * (256 - wy) + density_field[0][j1] * wy) >> 8;
+  uint8_t left_case = (density_field[0][j0] >= SIM_SURFACE_THRESHOLD) |
+                      ((density_field[0][j1] >= SIM_SURFACE_THRESHOLD) << 1);
+
+  for (int i = 0; i < SIM_PHYS_X_SIZE; i++) {
+    int i1 = i < SIM_PHYS_X_SIZE - 1 ? i + 1 : i;
+    int right =
+        (density_field[i1][j0] * (256 - wy) + density_field[i1][j1] * wy) >> 8;
+    uint8_t right_case = (density_field[i1][j0] >= SIM_SURFACE_THRESHOLD) |
+                         ((density_field[i1][j1] >= SIM_SURFACE_THRESHOLD) << 1);
+    uint8_t square = left_case | (right_case << 2);
+    uint8_t *span = dst + i * ratio;
+
+#if SIM_SHADE_WATER
+    // water takes the colour of the nearest node's cell
+    uint8_t left_water = cell_shade[i][j_near];
+    uint8_t right_water = cell_shade[i1][j_near];
+#else
+    uint8_t left_water = SIM_PAL_WATER;
+    uint8_t right_water = SIM_PAL_WATER;
+#endif
+
+    if (square == 0) {
+      memset(span, SIM_PAL_BACKGROUND, ratio);
+    } else if (square == 0x0F && left_water == right_water) {
+      memset(span, left_water, ratio);
+    } else {
+      // the contour (or a shade boundary) crosses this square
+      for (int p = 0; p < ratio; p++) {
+        int wx = ((2 * p + 1) << 8) / (2 * ratio);
+        int density = (left * (256 - wx) + right * wx) >> 8;
+        if (density < SIM_SURFACE_THRESHOLD) {
+          span[p] = SIM_PAL_BACKGROUND;
+        } else {
+          span[p] = wx < 128 ? left_water : right_water;
+        }
       }
-      image_buff[(2 * k * SIM_RENDER_X_SIZE) + (2 * j)] = pixel;
-      image_buff[(2 * k * SIM_RENDER_X_SIZE) + (2 * j + 1)] = pixel;
-      image_buff[((2 * k + 1) * SIM_RENDER_X_SIZE) + (2 * j)] = pixel;
-      image_buff[((2 * k + 1) * SIM_RENDER_X_SIZE) + (2 * j + 1)] = pixel;
     }
+
+    left = right;
+    left_case = right_case;
   }
+}
 
-  /*
-  image_buff[(0 * SIM_RENDER_X_SIZE) + 0] = pixel;
-  image_buff[(0 * SIM_RENDER_X_SIZE) + 1] = pixel;
-  image_buff[(1 * SIM_RENDER_X_SIZE) + 0] = pixel;
-  image_buff[(1 * SIM_RENDER_X_SIZE) + 1] = pixel;
-    */
+static void renderRowIndices(int y, uint8_t *dst) {
+  if (frame_render_mode == SIM_RENDER_SURFACE) {
+    renderSurfaceRowIndices(y, dst);
+  } else {
+    renderParticleRowIndices(y, dst);
+  }
+}
+
+// Accumulates every particle whose kernel reaches this band, then maps the
+// coverage to colour in one sweep over the band
+static void renderSplatBand(uint8_t band, uint16_t *dst) {
+  int y0 = band * OLED_BAND_ROWS;
+  int first = y0 - SIM_SPLAT_RADIUS;
+  int last = y0 + OLED_BAND_ROWS - 1 + SIM_SPLAT_RADIUS;
+  if (first < 0) {
+    first = 0;
+  }
+  if (last > SIM_RENDER_Y_SIZE - 1) {
+    last = SIM_RENDER_Y_SIZE - 1;
+  }
+
+  memset(splat_accum, 0, sizeof(splat_accum));
+
+  for (int y = first; y <= last; y++) {
+    for (int k = row_start[y]; k < row_start[y + 1]; k++) {
+      uint16_t pos = row_pos[k];
+      int x_q = ROW_POS_X(pos);
+      const uint8_t *kx = splat_kernel[x_q & SUBPIXEL_MASK];
+      const uint8_t *ky = splat_kernel[ROW_POS_Y_PHASE(pos)];
+      int px0 = (x_q >> SIM_SPLAT_SUBPIXEL_BITS) - SIM_SPLAT_RADIUS;
+
+      for (int ty = 0; ty < SPLAT_TAPS; ty++) {
+        int row = y + ty - SIM_SPLAT_RADIUS - y0;
+        if (row < 0 || row >= OLED_BAND_ROWS || ky[ty] == 0) {
+          continue;
+        }
+        uint16_t *acc = &splat_accum[row * SIM_RENDER_X_SIZE];
+        for (int tx = 0; tx < SPLAT_TAPS; tx++) {
+          int px = px0 + tx;
+          if (px >= 0 && px < SIM_RENDER_X_SIZE) {
+            // a few hundred particles on one pixel would wrap the counter
+            // and show the densest water as the lightest tone
+            int sum = acc[px] + ((kx[tx] * ky[ty]) >> 8);
+            acc[px] = sum > UINT16_MAX ? UINT16_MAX : sum;
+          }
+        }
+      }
+    }
+  }
+
+  for (int i = 0; i < OLED_BAND_PIXELS; i++) {
+    int level = splat_accum[i] >> SIM_SPLAT_TONE_SHIFT;
+    dst[i] = splat_tone[level < SIM_SPLAT_TONE_LEVELS ? level
+                                                      : SIM_SPLAT_TONE_LEVELS - 1];
+  }
+}
+
+void renderBand(uint8_t band, uint16_t *dst) {
+  if (frame_render_mode == SIM_RENDER_SPLAT) {
+    renderSplatBand(band, dst);
+    return;
+  }
+
+  int y = band * OLED_BAND_ROWS;
+  for (int row = 0; row < OLED_BAND_ROWS; row++, y++) {
+    renderRowIndices(y, row_scratch);
+    for (int x = 0; x < SIM_RENDER_X_SIZE; x++) {
+      *dst++ = sim_palette[row_scratch[x]];
+    }
+  }
+}
+
+void dummyBand(uint8_t band, uint16_t *dst) {
+  // 2x2 blocks, every other block in both directions is solid
+  int y = band * OLED_BAND_ROWS;
+  for (int row = 0; row < OLED_BAND_ROWS; row++, y++) {
+    for (int x = 0; x < SIM_RENDER_X_SIZE; x++) {
+      uint8_t pixel = SIM_PAL_WATER;
+      if (!((x / 2) % 2 || (y / 2) % 2)) {
+        pixel = SIM_PAL_SOLID;
+      }
+      *dst++ = sim_palette[pixel];
+    }
+  }
+}
+
+// tx_buff is free once the transfer carrying the previous frame is done. The
+// UART is waited for; over USB a frame that finds it busy is skipped instead.
+// A block still in flight holds tx_buff even after the host closes the port.
+static uint8_t streamReady(void) {
+#if USB_CDC_ENABLE
+  if (usb_cdc_block_busy()) {
+    return 0;
+  }
+  if (usb_cdc_is_open()) {
+    return 1;
+  }
+#endif
+  while (HAL_UART_GetState(&huart3) != HAL_UART_STATE_READY) {
+  }
+  return 1;
+}
+
+// Hands tx_buff[0 .. tx_buff_len) to USB if a host has the port open,
+// otherwise to the UART DMA. dlog shares USART3, so wait for it to drain and
+// retry if a record slips in first.
+static void streamSend(void) {
+#if USB_CDC_ENABLE
+  if (usb_cdc_send_block(tx_buff, tx_buff_len)) {
+    return;
+  }
+#endif
+  dlog_flush();
+  while (HAL_UART_Transmit_DMA(&huart3, tx_buff, tx_buff_len) == HAL_BUSY) {
+  }
 }
 
 void testPrint(void) {
+  if (!streamReady()) {
+    return;
+  }
+
   // Create a new buffer from the snapshot_buffer than the DCMI copied the
   // 16-bit pixel values into.
   tx_buff_len = 0;
@@ -689,8 +1054,13 @@ void testPrint(void) {
   }
     */
 
-  for (int k = 0; k < SIM_RENDER_X_SIZE * SIM_RENDER_Y_SIZE; k++) {
-    tx_buff[tx_buff_len++] = image_buff[k];
+  // One sim_palette index per byte (water_palette.h, as
+  // tools/frame_decode.py reads keyframes), rendered row by row from the
+  // particle bins. Before the band renderer this was the low byte of each
+  // RGB565 pixel; readers of that output need the palette now.
+  for (int y = 0; y < SIM_RENDER_Y_SIZE; y++) {
+    renderRowIndices(y, &tx_buff[tx_buff_len]);
+    tx_buff_len += SIM_RENDER_X_SIZE;
   }
   /*
 for (int i = 0; i < SIM_RENDER_X_SIZE; i++) {
@@ -723,9 +1093,93 @@ for (int k = 0; k < SIM_RENDER_Y_SIZE; k++) {
 
   // print_msg((char*) tx_buff);
 
-  while (HAL_UART_GetState(&huart3) != HAL_UART_STATE_READY) {
+  streamSend();
+}
+
+#if SIM_STREAM_FRAMES
+// The frame the host last reconstructed, as palette indices
+static uint8_t stream_prev[SIM_RENDER_Y_SIZE][SIM_RENDER_X_SIZE];
+static uint16_t stream_since_key = SIM_STREAM_KEYFRAME_INTERVAL;
+
+// PackBits: header n <= 127 is followed by n + 1 literal bytes, header
+// n >= 129 by one byte repeated 257 - n times. Returns the encoded length, or
+// 0 if it would not fit in room.
+static size_t streamPackBits(const uint8_t *src, size_t len, uint8_t *dst,
+                             size_t room) {
+  size_t out = 0;
+  size_t i = 0;
+
+  while (i < len) {
+    size_t run = 1;
+    while (i + run < len && run < 128 && src[i + run] == src[i]) {
+      run++;
+    }
+    if (run > 1) {
+      if (out + 2 > room) {
+        return 0;
+      }
+      dst[out++] = (uint8_t)(257 - run);
+      dst[out++] = src[i];
+      i += run;
+      continue;
+    }
+
+    // Literals up to the next pair of equal bytes
+    size_t lit = 1;
+    while (i + lit < len && lit < 128 &&
+           !(i + lit + 1 < len && src[i + lit] == src[i + lit + 1])) {
+      lit++;
+    }
+    if (out + 1 + lit > room) {
+      return 0;
+    }
+    dst[out++] = (uint8_t)(lit - 1);
+    memcpy(&dst[out], &src[i], lit);
+    out += lit;
+    i += lit;
+  }
+  return out;
+}
+
+void streamFrame(void) {
+  if (!streamReady()) {
+    return; // the host keeps the last frame; the next delta is against it
+  }
+
+  if (++stream_since_key < SIM_STREAM_KEYFRAME_INTERVAL) {
+    uint8_t row[SIM_RENDER_X_SIZE];
+    uint8_t delta[SIM_RENDER_X_SIZE];
+    size_t header = sizeof(DELTA_PREAMBLE) + 2;
+    size_t room = sizeof(tx_buff) - sizeof(SUFFIX);
+    size_t len = header;
+
+    memcpy(tx_buff, DELTA_PREAMBLE, sizeof(DELTA_PREAMBLE));
+    for (int y = 0; y < SIM_RENDER_Y_SIZE; y++) {
+      renderRowIndices(y, row);
+      for (int x = 0; x < SIM_RENDER_X_SIZE; x++) {
+        delta[x] = row[x] ^ stream_prev[y][x];
+        stream_prev[y][x] = row[x];
+      }
+      size_t n = streamPackBits(delta, SIM_RENDER_X_SIZE, &tx_buff[len],
+                                room - len);
+      if (n == 0) {
+        break; // busier than a keyframe, send one instead
+      }
+      len += n;
+      if (y == SIM_RENDER_Y_SIZE - 1) {
+        size_t payload = len - header;
+        tx_buff[sizeof(DELTA_PREAMBLE)] = payload & 0xFF;
+        tx_buff[sizeof(DELTA_PREAMBLE) + 1] = payload >> 8;
+        memcpy(&tx_buff[len], SUFFIX, sizeof(SUFFIX));
+        tx_buff_len = len + sizeof(SUFFIX);
+        streamSend();
+        return;
+      }
+    }
   }
 
-  HAL_UART_Transmit_DMA(&huart3, (uint8_t *)tx_buff,
-                        sizeof(PREAMBLE) + SIM_X_SIZE * SIM_Y_SIZE);
+  stream_since_key = 0;
+  testPrint();
+  memcpy(stream_prev, &tx_buff[sizeof(PREAMBLE)], sizeof(stream_prev));
 }
+#endif
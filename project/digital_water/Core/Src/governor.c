@@ -0,0 +1,123 @@
+#include "governor.h"
+#include "fluid_sim.h"
+#include "dlog.h"
+
+typedef struct
+{
+  uint8_t separate_iterations;
+  uint8_t grid_iterations;
+  uint8_t render_degraded;
+  uint8_t display_divider; // draw every Nth frame
+} Gov_Level_t;
+
+#define GOV_SEPARATE_CUT (SIM_PARTICLE_SEPARATE_ITERATIONS / 2)
+#define GOV_GRID_CUT ((SIM_GRID_ITERATIONS + 1) / 2)
+
+static const Gov_Level_t gov_levels[GOV_LEVEL_COUNT] = {
+  [GOV_LEVEL_FULL] = {SIM_PARTICLE_SEPARATE_ITERATIONS, SIM_GRID_ITERATIONS, 0, 1},
+  [GOV_LEVEL_SEPARATE] = {GOV_SEPARATE_CUT, SIM_GRID_ITERATIONS, 0, 1},
+  [GOV_LEVEL_GRID] = {GOV_SEPARATE_CUT, GOV_GRID_CUT, 0, 1},
+  [GOV_LEVEL_RENDER] = {GOV_SEPARATE_CUT, GOV_GRID_CUT, 1, 1},
+  [GOV_LEVEL_SKIP_DISPLAY] = {GOV_SEPARATE_CUT, GOV_GRID_CUT, 1, 2},
+};
+
+uint8_t gov_level;
+uint32_t gov_frames_skipped;
+
+static uint32_t frame_count;
+static uint8_t frame_drawn;
+static uint32_t window_worst;   // cycles, drawn frames only
+static uint8_t window_frames;
+static uint8_t windows_over;    // in a row over budget
+static uint16_t windows_under;  // in a row under GOV_UP_PERCENT of it
+static uint16_t windows_since_up = UINT16_MAX;
+static uint8_t up_backoff;      // GOV_UP_WINDOWS << up_backoff to step up
+
+static uint8_t gov_same(uint8_t a, uint8_t b)
+{
+  return memcmp(&gov_levels[a], &gov_levels[b], sizeof(Gov_Level_t)) == 0;
+}
+
+static void gov_apply(uint8_t level)
+{
+  const Gov_Level_t *cuts = &gov_levels[level];
+
+  gov_level = level;
+  sim_separate_iterations = cuts->separate_iterations;
+  sim_grid_iterations = cuts->grid_iterations;
+  sim_render_degraded = cuts->render_degraded;
+}
+
+void gov_init(void)
+{
+  gov_apply(GOV_LEVEL_FULL);
+}
+
+void gov_frame_begin(void)
+{
+  frame_drawn = frame_count++ % gov_levels[gov_level].display_divider == 0;
+  if (!frame_drawn) gov_frames_skipped++;
+}
+
+uint8_t gov_draw_frame(void)
+{
+  return frame_drawn;
+}
+
+static void gov_step_down(void)
+{
+  uint8_t level = gov_level;
+
+  while (level < GOV_LEVEL_COUNT - 1 && gov_same(level, gov_level)) level++;
+  if (gov_same(level, gov_level)) return; // nothing left to cut
+
+  // The last step up didn't hold: wait longer before the next one
+  if (windows_since_up < GOV_UP_WINDOWS && up_backoff < GOV_UP_BACKOFF_MAX) up_backoff++;
+  gov_apply(level);
+}
+
+static void gov_step_up(void)
+{
+  uint8_t level = gov_level;
+
+  while (level > GOV_LEVEL_FULL && gov_same(level, gov_level)) level--;
+  // Land on the first of any run of equal levels, so the next step down
+  // skips them too
+  while (level > GOV_LEVEL_FULL && gov_same(level - 1, level)) level--;
+  windows_since_up = 0;
+  gov_apply(level);
+}
+
+void gov_frame_end(uint32_t work_cycles)
+{
+#if GOV_ENABLE
+  if (frame_drawn && work_cycles > window_worst) window_worst = work_cycles;
+  if (++window_frames < GOV_WINDOW_FRAMES) return;
+
+  uint32_t budget = SystemCoreClock / SIM_RENDER_FPS;
+  uint8_t level = gov_level;
+
+  if (windows_since_up < UINT16_MAX) windows_since_up++;
+  // A step up that held for a while clears one doubling of the wait
+  if (windows_since_up == GOV_UP_WINDOWS && up_backoff) up_backoff--;
+
+  if (window_worst > budget) {
+    windows_under = 0;
+    if (++windows_over >= GOV_DOWN_WINDOWS) gov_step_down();
+  } else if (window_worst < budget / 100 * GOV_UP_PERCENT && gov_level != GOV_LEVEL_FULL) {
+    windows_over = 0;
+    if (++windows_under >= GOV_UP_WINDOWS << up_backoff) gov_step_up();
+  } else {
+    windows_over = 0;
+    windows_under = 0;
+  }
+
+  if (gov_level != level) {
+    DLOG(DLOG_GOV_LEVEL, gov_level, window_worst, budget);
+    windows_over = 0;
+    windows_under = 0;
+  }
+  window_worst = 0;
+  window_frames = 0;
+#endif
+}
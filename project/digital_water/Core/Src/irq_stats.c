@@ -0,0 +1,145 @@
+#include "irq_stats.h"
+#include "prof.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef char irq_stats_trace_check[TRACE_OTG_FS - TRACE_DMA1_STREAM0 == IRQ_STATS_COUNT - 1 ? 1 : -1];
+
+#if IRQ_STATS_ENABLE
+
+Irq_Stats_t irq_stats[IRQ_STATS_COUNT];
+
+static const struct
+{
+  IRQn_Type irqn;
+  const char *name;
+} irq_table[IRQ_STATS_COUNT] = {
+  [IRQ_STATS_DMA1_STREAM0] = {DMA1_Stream0_IRQn, "DMA1_Stream0 SPI3 RX"},
+  [IRQ_STATS_DMA1_STREAM3] = {DMA1_Stream3_IRQn, "DMA1_Stream3 USART3 TX"},
+  [IRQ_STATS_DMA1_STREAM5] = {DMA1_Stream5_IRQn, "DMA1_Stream5 SPI3 TX"},
+  [IRQ_STATS_EXTI15_10] = {EXTI15_10_IRQn, "EXTI15_10"},
+  [IRQ_STATS_TIM6] = {TIM6_DAC_IRQn, "TIM6"},
+  [IRQ_STATS_DMA2_STREAM3] = {DMA2_Stream3_IRQn, "DMA2_Stream3 SPI1 TX"},
+  [IRQ_STATS_USART3] = {USART3_IRQn, "USART3"},
+  [IRQ_STATS_OTG_FS] = {OTG_FS_IRQn, "OTG_FS"},
+};
+
+// Handlers currently running, innermost last. A handler can only be
+// preempted by a higher level, so the stack is at most one per level deep.
+static uint8_t stack[IRQ_STATS_COUNT];
+static uint8_t depth;
+static uint32_t entered[IRQ_STATS_COUNT];   // CYCCNT at entry
+static uint32_t preempted[IRQ_STATS_COUNT]; // cycles spent in nested handlers
+
+void irq_stats_init(void)
+{
+  prof_cycles_enable();
+  irq_stats_reset();
+}
+
+void irq_stats_reset(void)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  memset(irq_stats, 0, sizeof(irq_stats));
+  __set_PRIMASK(primask);
+}
+
+void irq_stats_enter(uint8_t irq)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  entered[irq] = DWT->CYCCNT;
+  preempted[irq] = 0;
+  stack[depth++] = irq;
+  __set_PRIMASK(primask);
+}
+
+void irq_stats_exit(uint8_t irq)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  uint32_t total = DWT->CYCCNT - entered[irq];
+  uint32_t own = total - preempted[irq];
+  Irq_Stats_t *s = &irq_stats[irq];
+
+  depth--;
+  // The handler this one interrupted gets the whole span taken off its own
+  if (depth) preempted[stack[depth - 1]] += total;
+  s->count++;
+  s->sum += own;
+  if (own > s->max) s->max = own;
+  __set_PRIMASK(primask);
+}
+
+void irq_stats_latency(uint8_t irq, uint32_t cycles, uint32_t step)
+{
+  Irq_Stats_t *s = &irq_stats[irq];
+
+  s->lat_step = step;
+  if (s->lat_count == 0 || cycles < s->lat_min) s->lat_min = cycles;
+  if (cycles > s->lat_max) s->lat_max = cycles;
+  s->lat_count++;
+  s->lat_sum += cycles;
+}
+
+static uint32_t irq_stats_preempt(uint8_t irq)
+{
+  uint32_t preempt, sub;
+
+  NVIC_DecodePriority(NVIC_GetPriority(irq_table[irq].irqn), NVIC_GetPriorityGrouping(), &preempt, &sub);
+  return preempt;
+}
+
+// Worst case wait before irq runs: the longest other handler at its own
+// preemption level, which must finish first, plus every handler above it
+// running once at its longest
+static uint32_t irq_stats_bound(uint8_t irq)
+{
+  uint32_t level = irq_stats_preempt(irq);
+  uint32_t same = 0, above = 0;
+
+  for (uint8_t i = 0; i < IRQ_STATS_COUNT; i++) {
+    uint32_t other = irq_stats_preempt(i);
+
+    if (i == irq) continue;
+    if (other < level) above += irq_stats[i].max;
+    else if (other == level && irq_stats[i].max > same) same = irq_stats[i].max;
+  }
+  return same + above;
+}
+
+// All figures in cycles, like prof_dump()
+void irq_stats_dump(void)
+{
+  char line[112];
+
+  print_msg("irq                    pri    count      avg      max  lat min  lat max     bound\n");
+  for (uint8_t i = 0; i < IRQ_STATS_COUNT; i++) {
+    const Irq_Stats_t *s = &irq_stats[i];
+    uint32_t preempt, sub;
+    uint32_t avg = s->count ? (uint32_t)(s->sum / s->count) : 0;
+    char lat_min[12] = "-", lat_max[12] = "-";
+
+    NVIC_DecodePriority(NVIC_GetPriority(irq_table[i].irqn), NVIC_GetPriorityGrouping(), &preempt, &sub);
+    if (s->lat_count) {
+      snprintf(lat_min, sizeof(lat_min), "%lu", (unsigned long)s->lat_min);
+      snprintf(lat_max, sizeof(lat_max), "%lu", (unsigned long)s->lat_max);
+    }
+    snprintf(line, sizeof(line), "%-22s %lu/%lu %8lu %8lu %8lu %8s %8s %9lu\n", irq_table[i].name,
+             (unsigned long)preempt, (unsigned long)sub, (unsigned long)s->count, (unsigned long)avg,
+             (unsigned long)s->max, lat_min, lat_max, (unsigned long)irq_stats_bound(i));
+    print_msg(line);
+  }
+  for (uint8_t i = 0; i < IRQ_STATS_COUNT; i++) {
+    if (!irq_stats[i].lat_count) continue;
+    snprintf(line, sizeof(line), "%s latency in steps of %lu cycles, rounded down\n", irq_table[i].name,
+             (unsigned long)irq_stats[i].lat_step);
+    print_msg(line);
+  }
+}
+
+#endif
@@ -0,0 +1,173 @@
+#include "m2p.h"
+#include "prof.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef M2P_HOST
+uint32_t m2p_host_cycles;
+#endif
+
+#if M2P_ENABLE
+
+// One input on its way to the panel, as cycle counts
+typedef struct
+{
+  uint32_t sample;
+  uint32_t gravity;
+  uint32_t step;
+  uint32_t render;
+  uint8_t valid;
+} M2p_Chain_t;
+
+M2p_Hop_t m2p_hops[M2P_HOP_COUNT];
+
+static const char *const hop_names[M2P_HOP_COUNT] = {
+  [M2P_HOP_FILTER] = "sample -> gravity",
+  [M2P_HOP_STEP] = "gravity -> step",
+  [M2P_HOP_RENDER] = "step -> render",
+  [M2P_HOP_DISPLAY] = "render -> photon",
+  [M2P_HOP_TOTAL] = "sample -> photon",
+};
+
+static M2p_Chain_t gravity_chain;  // gravity computed, not stepped yet
+static M2p_Chain_t stepped_chain;  // stepped, not rendered yet
+static M2p_Chain_t rendered_chain; // rendered, not handed to the display yet
+
+// oled_drawframe() waits for the previous frame before starting one, so at
+// most the frame on the bus and the one being handed over are outstanding
+static M2p_Chain_t frames[2];
+static uint32_t photon[2];
+static volatile uint32_t started;  // frames handed to the display
+static volatile uint32_t finished; // frames whose last band was sent
+static uint32_t collected;
+
+void m2p_init(void)
+{
+  prof_cycles_enable();
+  m2p_reset();
+}
+
+void m2p_reset(void)
+{
+  memset(m2p_hops, 0, sizeof(m2p_hops));
+  gravity_chain.valid = 0;
+  stepped_chain.valid = 0;
+  rendered_chain.valid = 0;
+  collected = finished;
+  started = finished;
+}
+
+uint32_t m2p_sample_stamp(uint8_t index, uint8_t count, uint32_t sample_hz)
+{
+  return M2P_NOW() - (uint32_t)(count - 1 - index) * (M2P_CORE_HZ / sample_hz);
+}
+
+void m2p_gravity(uint32_t sample_stamp)
+{
+  gravity_chain.sample = sample_stamp;
+  gravity_chain.gravity = M2P_NOW();
+  gravity_chain.valid = 1;
+}
+
+void m2p_stepped(void)
+{
+  if (!gravity_chain.valid) return;
+  stepped_chain = gravity_chain;
+  stepped_chain.step = M2P_NOW();
+  gravity_chain.valid = 0;
+}
+
+void m2p_rendered(void)
+{
+  // A frame without a new step still goes through, marked as not counted
+  rendered_chain = stepped_chain;
+  rendered_chain.render = M2P_NOW();
+  stepped_chain.valid = 0;
+}
+
+void m2p_display_start(void)
+{
+  frames[started & 1] = rendered_chain;
+  rendered_chain.valid = 0;
+  started++;
+}
+
+// SPI1 DMA completion interrupt
+void m2p_photon(void)
+{
+  if (finished == started) return;
+  photon[finished & 1] = M2P_NOW();
+  finished++;
+}
+
+static void m2p_record(uint8_t hop, uint32_t cycles)
+{
+  M2p_Hop_t *h = &m2p_hops[hop];
+  uint32_t bucket = cycles / (M2P_CORE_HZ / 1000000) / M2P_BUCKET_US;
+
+  if (bucket >= M2P_BUCKETS) bucket = M2P_BUCKETS - 1;
+  if (h->count == 0 || cycles < h->min) h->min = cycles;
+  if (cycles > h->max) h->max = cycles;
+  h->count++;
+  h->sum += cycles;
+
+  // A full bucket halves the whole histogram, keeping its shape
+  if (h->hist[bucket] == UINT16_MAX) {
+    for (uint8_t i = 0; i < M2P_BUCKETS; i++) h->hist[i] >>= 1;
+  }
+  h->hist[bucket]++;
+}
+
+void m2p_collect(void)
+{
+  while (collected != finished) {
+    const M2p_Chain_t *c = &frames[collected & 1];
+    uint32_t shown = photon[collected & 1];
+
+    if (c->valid) {
+      m2p_record(M2P_HOP_FILTER, c->gravity - c->sample);
+      m2p_record(M2P_HOP_STEP, c->step - c->gravity);
+      m2p_record(M2P_HOP_RENDER, c->render - c->step);
+      m2p_record(M2P_HOP_DISPLAY, shown - c->render);
+      m2p_record(M2P_HOP_TOTAL, shown - c->sample);
+    }
+    collected++;
+  }
+}
+
+uint32_t m2p_percentile_us(uint8_t hop, uint8_t percent)
+{
+  const M2p_Hop_t *h = &m2p_hops[hop];
+  uint32_t max_us = h->max / (M2P_CORE_HZ / 1000000);
+  uint32_t total = 0, seen = 0;
+
+  for (uint8_t i = 0; i < M2P_BUCKETS; i++) total += h->hist[i];
+  if (total == 0) return 0;
+  for (uint8_t i = 0; i < M2P_BUCKETS - 1; i++) {
+    seen += h->hist[i];
+    if (seen * 100 >= total * percent) {
+      uint32_t top = (i + 1) * M2P_BUCKET_US - 1;
+      return top < max_us ? top : max_us;
+    }
+  }
+  return max_us;
+}
+
+void m2p_dump(void)
+{
+  char line[96];
+  uint32_t per_us = M2P_CORE_HZ / 1000000;
+
+  PROF_PRINT("latency (us)           count      min      p50      avg      p99      max\n");
+  for (uint8_t i = 0; i < M2P_HOP_COUNT; i++) {
+    const M2p_Hop_t *h = &m2p_hops[i];
+    uint32_t avg = h->count ? (uint32_t)(h->sum / h->count) : 0;
+    snprintf(line, sizeof(line), "%-20s %8lu %8lu %8lu %8lu %8lu %8lu\n", hop_names[i],
+             (unsigned long)h->count, (unsigned long)(h->min / per_us),
+             (unsigned long)m2p_percentile_us(i, 50), (unsigned long)(avg / per_us),
+             (unsigned long)m2p_percentile_us(i, 99), (unsigned long)(h->max / per_us));
+    PROF_PRINT(line);
+  }
+}
+
+#endif
@@ -25,6 +25,20 @@
 #include "accelerometer.h"
 #include "fluid_sim.h"
 #include "physics.h"
+#include "orientation.h"
+#include "spi_ll.h"
+#include "dlog.h"
+#include "telemetry.h"
+#include "usb_cdc.h"
+#include "sim_tick.h"
+#include "governor.h"
+#include "prof.h"
+#include "pcsamp.h"
+#include "trace.h"
+#include "irq_stats.h"
+#include "m2p.h"
+#include "stack_paint.h"
+#include "sched.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -34,7 +48,7 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
-
+#define FRAME_MS (1000 / SIM_RENDER_FPS)
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -46,6 +60,7 @@
 SPI_HandleTypeDef hspi1;
 SPI_HandleTypeDef hspi3;
 DMA_HandleTypeDef hdma_spi1_tx;
+DMA_HandleTypeDef hdma_spi3_rx;
 DMA_HandleTypeDef hdma_spi3_tx;
 
 TIM_HandleTypeDef htim6;
@@ -69,6 +84,12 @@ static void MX_USART3_UART_Init(void);
 static void MX_USB_OTG_FS_PCD_Init(void);
 static void MX_SPI3_Init(void);
 /* USER CODE BEGIN PFP */
+static void motion_sleep(void);
+static void sensor_task(void);
+static void physics_task(void);
+static void render_task(void);
+static void display_task(void);
+static void telemetry_task(void);
 
 /* USER CODE END PFP */
 
@@ -78,16 +99,13 @@ int16_t accel_data[3];
 // 0 --> XDATA
 // 1 --> YDATA
 // 2 --> ZDATA
-double roll = 0.00, pitch = 0.00;
 int16_t x = 0, y = 0, z = 0;
-float x_g = 0.0, y_g = 0.0, z_g = 0.0;
 
 uint8_t btn_press = 0;
 uint16_t colors[3] = {RED, GREEN, BLUE};
 
 Sim_Cell_t grid_array[SIM_PHYS_X_SIZE][SIM_PHYS_Y_SIZE];
 Sim_Particle_t particle_array[SIM_PARTICLE_COUNT];
-uint16_t image_buff[SIM_RENDER_X_SIZE * SIM_RENDER_Y_SIZE];
 Sim_Particle_t obstacle_array[SIM_OBSTACLE_COUNT];
 Vec2_t GravityVector;
 
@@ -95,20 +113,35 @@ uint8_t tx_buff[sizeof(PREAMBLE) + SIM_RENDER_X_SIZE * SIM_RENDER_Y_SIZE +
 									sizeof(SUFFIX)];
 size_t tx_buff_len;
 
+// Particles, grid and frame buffers against SIM_RAM_BUDGET (fluid_sim.h). The
+// band ring in oled.c and the splat accumulator in fluid_sim.c are a band each.
+#define SIM_RAM_BYTES (sizeof(particle_array) + SIM_PARTICLE_COUNT * SIM_PARTICLE_SIDE_BYTES + \
+											 sizeof(grid_array) + (SIM_PHYS_X_SIZE) * (SIM_PHYS_Y_SIZE) * SIM_CELL_SIDE_BYTES + \
+											 sizeof(tx_buff) + (OLED_BAND_BUFFERS + 1) * OLED_BAND_PIXELS * sizeof(uint16_t) + \
+											 SIM_STREAM_FRAMES * SIM_RENDER_X_SIZE * SIM_RENDER_Y_SIZE)
+typedef char sim_ram_budget_check[SIM_RAM_BYTES <= SIM_RAM_BUDGET ? 1 : -1];
+
 int sim_time = 0;
 char main_msg[140];
+
+// Frame state handed from task to task
+static uint16_t frame_samples; // samples filtered since the last frame packet
+static uint16_t frame_steps;   // physics steps since the last frame packet
+static uint8_t frame_drawn;    // the render task drew this frame
+static uint8_t frame_done;     // the display task finished it, packet not sent
 /* USER CODE END 0 */
 
 /**
   * @brief  The application entry point.
   * @retval int
   */
-int overflow = 0;
 int main(void)
 {
 
   /* USER CODE BEGIN 1 */
-
+#if STACK_PAINT_ENABLE
+	stack_paint();
+#endif
   /* USER CODE END 1 */
 
   /* MCU Configuration--------------------------------------------------------*/
@@ -147,19 +180,56 @@ int main(void)
 
 	
 
+#if SPI_LL_BENCH
+  // Device ID read: harmless to repeat, and INT1 reads are not running yet
+  static const uint8_t accel_bench[3] = {0x0B, 0x00, 0};
+  spi_ll_benchmark("Accel", &hspi3, ACCEL_CS_GPIO_Port, ACCEL_CS_Pin, accel_bench, sizeof(accel_bench));
+#endif
+  orient_reset();
   accel_init();
   HAL_Delay(10);
   oled_init();
   HAL_Delay(10);
+#if SPI_LL_BENCH
+  static const uint8_t oled_bench[1] = {CMD_NOP};
+  HAL_GPIO_WritePin(OLED_DCL_GPIO_Port, OLED_DCL_Pin, GPIO_PIN_RESET);
+  spi_ll_benchmark("OLED", &hspi1, OLED_CS_GPIO_Port, OLED_CS_Pin, oled_bench, sizeof(oled_bench));
+#endif
   oled_eraseRect(0, 0, RGB_OLED_WIDTH - 1, RGB_OLED_HEIGHT - 1); // Clearing screen
   Sim_Physics_Init();
   const int delayTime = (40 * SIM_PHYSICS_FPS) / 2;
 	GravityVector = (Vec2_t){.x = 0, .y = SIM_GRAV};
 
-  print_msg("starting while loop\n");
-	
-	// FPS calculation
-	HAL_TIM_Base_MspInit(&htim6);
+  telem_init();
+  gov_init();
+  prof_init();
+#if TRACE_ENABLE
+  trace_init();
+#endif
+#if IRQ_STATS_ENABLE
+  irq_stats_init();
+#endif
+#if M2P_ENABLE
+  m2p_init();
+#endif
+#if USB_CDC_ENABLE
+  usb_cdc_init();
+#endif
+  // Sensor input first so a step sees the newest gravity, then the display
+  // handoff (short, and it starts the panel DMA), physics before the render
+  // that interpolates its states, and the telemetry and dumps last
+  sched_task_init(SCHED_TASK_SENSOR, "sensor", sensor_task, 0, 0, FRAME_MS);
+  sched_task_init(SCHED_TASK_DISPLAY, "display", display_task, 1, 0, FRAME_MS);
+  sched_task_init(SCHED_TASK_PHYSICS, "physics", physics_task, 2, 0, SIM_DELAY_MS);
+  sched_task_init(SCHED_TASK_RENDER, "render", render_task, 3, FRAME_MS, FRAME_MS);
+  sched_task_init(SCHED_TASK_TELEMETRY, "telemetry", telemetry_task, 4, 0, FRAME_MS);
+  print_msg("starting scheduler\n");
+
+  sim_tick_start();
+#if PCSAMP_ENABLE
+  pcsamp_start();
+#endif
+  sched_run(); // does not return
 
   /* USER CODE END 2 */
 
@@ -170,51 +240,6 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
-		if(overflow > 0){
-			print_msg("DAB");
-		}
-		accel_poll(accel_data);
-
-		x = (int16_t)accel_data[0], y = (int16_t)accel_data[1], z = (int16_t)accel_data[2];
-			
-		// Convert into g's
-			
-		x_g = (float)x*(float)1.0/1024.0;
-		y_g = (float)y*(float)1.0/1024.0;
-		z_g = (float)z*(float)1.0/1024.0;
-		// Compute pitch & roll.
-		roll = atan(y_g / sqrt(pow(x_g, 2) + pow(z_g, 2)));
-		pitch = atan(x_g / sqrt(pow(y_g, 2) + pow(z_g, 2)));
-		// Compute gravity vector. 
-		GravityVector.x = (-1.0)*sin(roll);
-		GravityVector.y = sin(pitch);
-
-		GravityVector = Normalize_V2(GravityVector);
-		GravityVector.x *= SIM_GRAV;
-		GravityVector.y *= SIM_GRAV;
-
-		//HAL_TIM_Base_Start_IT(&htim6);
-
-		Sim_Physics_Step();
-		renderImage();
-		/*
-		HAL_TIM_Base_Stop(&htim6);
-	uint16_t time = __HAL_TIM_GET_COUNTER(&htim6);
-	sprintf(main_msg, "Overflow value: %d\nTime: %d\n", overflow, time);
-	print_msg(main_msg);
-	
-	while(1)
-		;
-		*/
-		oled_drawframe(image_buff);
-		
-    if (btn_press)
-    {
-			//GravityVector = ScalarMult_V2(GravityVector, -1);
-			sprintf(main_msg, "X: %d\nY: %d\nZ: %d\nRoll: %f\nPitch: %f\nGravity X: %f\nGravity Y: %f\n", x, y, z, roll*57.3, pitch*57.3, GravityVector.x,GravityVector.y);
-			print_msg(main_msg);
-      btn_press = 0;
-    }
   }
   /* USER CODE END 3 */
 }
@@ -458,14 +483,17 @@ static void MX_DMA_Init(void)
   __HAL_RCC_DMA2_CLK_ENABLE();
 
   /* DMA interrupt init */
+  /* DMA1_Stream0_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Stream0_IRQn, 1, 1);
+  HAL_NVIC_EnableIRQ(DMA1_Stream0_IRQn);
   /* DMA1_Stream3_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(DMA1_Stream3_IRQn, 0, 0);
+  HAL_NVIC_SetPriority(DMA1_Stream3_IRQn, 3, 1);
   HAL_NVIC_EnableIRQ(DMA1_Stream3_IRQn);
   /* DMA1_Stream5_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(DMA1_Stream5_IRQn, 0, 0);
+  HAL_NVIC_SetPriority(DMA1_Stream5_IRQn, 1, 2);
   HAL_NVIC_EnableIRQ(DMA1_Stream5_IRQn);
   /* DMA2_Stream3_IRQn interrupt configuration */
-  HAL_NVIC_SetPriority(DMA2_Stream3_IRQn, 0, 0);
+  HAL_NVIC_SetPriority(DMA2_Stream3_IRQn, 2, 0);
   HAL_NVIC_EnableIRQ(DMA2_Stream3_IRQn);
 
 }
@@ -581,7 +609,7 @@ static void MX_GPIO_Init(void)
   HAL_GPIO_Init(OLED_PMODEN_GPIO_Port, &GPIO_InitStruct);
 
   /* EXTI interrupt init*/
-  HAL_NVIC_SetPriority(EXTI15_10_IRQn, 0, 0);
+  HAL_NVIC_SetPriority(EXTI15_10_IRQn, 1, 0);
   HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
 
   /* USER CODE BEGIN MX_GPIO_Init_2 */
@@ -591,13 +619,206 @@ static void MX_GPIO_Init(void)
 
 /* USER CODE BEGIN 4 */
 
+// Runs every sample the INT1 DMA reads queued through the orientation filter
+// at sensor rate; keeps the previous gravity if the board is lying flat
+static void sensor_task(void)
+{
+	Accel_Sample_t sample;
+	uint16_t samples = 0;
+	uint32_t newest_stamp = 0;
+
+	telem_stage_begin();
+	PROF_BEGIN(PROF_ACCEL_POLL);
+	while (accel_ring_pop(&sample)) {
+		orient_update(sample.x, sample.y, sample.z);
+		newest_stamp = sample.stamp;
+		samples++;
+	}
+	PROF_END(PROF_ACCEL_POLL);
+	frame_samples += samples;
+
+	float grav_x, grav_y;
+	if (orient_gravity(&grav_x, &grav_y)) {
+		GravityVector.x = grav_x * SIM_GRAV;
+		GravityVector.y = grav_y * SIM_GRAV;
+#if M2P_ENABLE
+		if (samples) m2p_gravity(newest_stamp);
+#endif
+	}
+	telem_stage_end(TELEM_STAGE_ACCEL);
+}
+
+// One step per TIM6 tick since the last run
+static void physics_task(void)
+{
+	telem_stage_begin();
+	uint8_t steps = sim_tick_take();
+	for (uint8_t i = 0; i < steps; i++) {
+		Sim_Physics_Step();
+#if M2P_ENABLE
+		m2p_stepped();
+#endif
+	}
+	frame_steps += steps;
+	telem_stage_end(TELEM_STAGE_PHYSICS);
+}
+
+static void render_task(void)
+{
+	// Motion gate: once the ADXL362 has timed out on inactivity and the
+	// water is still, stop stepping and drawing until it moves again. The
+	// panel keeps showing the last frame, and the simulation resumes from
+	// the same state.
+	if (!accel_awake() && Sim_Settled()) {
+		TRACE_BEGIN(TRACE_MOTION_SLEEP, 0);
+		motion_sleep();
+		TRACE_END(TRACE_MOTION_SLEEP, 0);
+		return;
+	}
+
+	TRACE_BEGIN(TRACE_FRAME, 0);
+	gov_frame_begin();
+	// Frames the governor skips keep stepping physics but leave the panel
+	// (and the stream) on the last frame drawn. Draw between the last two
+	// steps by how far the clock is into the next one.
+	frame_drawn = gov_draw_frame();
+	if (frame_drawn) {
+		telem_stage_begin();
+		sim_render_alpha = sim_tick_alpha();
+		PROF_BEGIN(PROF_RENDER_IMAGE);
+		renderImage();
+		PROF_END(PROF_RENDER_IMAGE);
+		telem_stage_end(TELEM_STAGE_RENDER);
+#if M2P_ENABLE
+		m2p_rendered();
+#endif
+	}
+	sched_signal(SCHED_TASK_DISPLAY);
+}
+
+static void display_task(void)
+{
+	if (frame_drawn) {
+		telem_stage_begin();
+#if M2P_ENABLE
+		m2p_display_start();
+#endif
+		PROF_BEGIN(PROF_OLED_DRAWFRAME);
+		oled_drawframe(renderBand);
+		PROF_END(PROF_OLED_DRAWFRAME);
+		telem_stage_end(TELEM_STAGE_DISPLAY);
+#if SIM_STREAM_FRAMES
+		streamFrame();
+#endif
+	}
+	TRACE_END(TRACE_FRAME, frame_steps);
+	frame_done = 1;
+	sched_signal(SCHED_TASK_TELEMETRY);
+}
+
+// Released by the display task at the end of a frame and by the button
+static void telemetry_task(void)
+{
+	if (frame_done) {
+		// The frame runs from the last packet to here, so the governor sees
+		// the sensor and physics runs that landed between render releases
+		gov_frame_end(telem_frame_work());
+		telem_frame_end(frame_samples, frame_steps);
+		frame_samples = 0;
+		frame_steps = 0;
+		frame_done = 0;
+#if M2P_ENABLE
+		m2p_collect();
+#endif
+	}
+
+	if (btn_press)
+	{
+		//GravityVector = ScalarMult_V2(GravityVector, -1);
+		orient_filtered(accel_data);
+		x = accel_data[0], y = accel_data[1], z = accel_data[2];
+		DLOG(DLOG_SAMPLE, x, y, z, DLOG_F(GravityVector.x), DLOG_F(GravityVector.y));
+#if ORIENT_PROFILE
+		DLOG(DLOG_ORIENT_CYCLES, orient_update_cycles, orient_gravity_cycles);
+#endif
+		DLOG(DLOG_PHYSICS_TICKS, sim_ticks_late, sim_ticks_dropped);
+#if STACK_PAINT_ENABLE
+		DLOG(DLOG_STACK, stack_high_water(), stack_size());
+#endif
+#if PROF_ENABLE
+		prof_dump();
+#endif
+#if PCSAMP_ENABLE
+		pcsamp_dump();
+#endif
+#if TRACE_ENABLE
+		trace_dump();
+#endif
+		if (telem_dumps_cut) DLOG(DLOG_DUMPS_CUT, telem_dumps_cut);
+#if IRQ_STATS_ENABLE
+		irq_stats_dump();
+#endif
+#if M2P_ENABLE
+		m2p_dump();
+#endif
+		sched_dump();
+		btn_press = 0;
+	}
+}
+
+// Sleeps in WFI until the accelerometer reports activity on INT1
+static void motion_sleep(void)
+{
+	while (oled_frame_busy())
+		;
+	HAL_StatusTypeDef status;
+	while ((status = accel_wake_arm()) == HAL_BUSY)
+		;
+	if (status != HAL_OK) return; // nothing would wake us
+
+	// SysTick and the physics clock would wake the core every few milliseconds
+	sim_tick_stop();
+#if PCSAMP_ENABLE
+	pcsamp_stop();
+#endif
+	HAL_SuspendTick();
+
+	// Interrupts stay masked between the check and WFI so a wake-up landing
+	// in between is not slept through; WFI still returns on the pending IRQ
+	__disable_irq();
+	while (!accel_awake()) {
+		__WFI();
+		__enable_irq();
+		__disable_irq();
+	}
+	__enable_irq();
+
+	HAL_ResumeTick();
+	sim_tick_start(); // the time asleep is not a backlog of steps
+#if PCSAMP_ENABLE
+	pcsamp_start();
+#endif
+}
+
 void my_print_amsg(char *amsg)
 {
-  HAL_UART_Transmit(&huart3, (uint8_t *)amsg, strlen(amsg), 100);
+  print_msg(amsg);
+}
+// TIM2-7 and TIM12-14 hang off APB1; their clock is doubled whenever APB1 is
+// divided
+uint32_t apb1_timer_clock(void)
+{
+	uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+	return (RCC->CFGR & RCC_CFGR_PPRE1) == RCC_CFGR_PPRE1_DIV1 ? pclk1 : 2 * pclk1;
 }
+
+// Queued as a text record on the deferred log, so it does not wait on the UART
 void print_msg(char *msg) {
+#if DLOG_ENABLE
+  dlog_text(msg);
+#else
    HAL_UART_Transmit(&huart3, (uint8_t *)msg, strlen(msg), 100);
-  
+#endif
 }
 
 /* USER CODE END 4 */
@@ -1,4 +1,7 @@
 #include "oled.h"
+#include "spi_ll.h"
+#include "spi_queue.h"
+#include "m2p.h"
 // Resources
 // https://digilent.com/reference/pmod/pmodoledrgb/reference-manual?redirect=1 -- Initialization commands
 // https://digilent.com/reference/pmod/pmodoledrgb/start?redirect=1 -- Pinout
@@ -11,7 +14,6 @@
 
 extern SPI_HandleTypeDef hspi1;
 extern UART_HandleTypeDef huart3;
-extern TIM_HandleTypeDef htim6;
 
 HAL_StatusTypeDef oled_init(void) {
 	
@@ -103,37 +105,34 @@ HAL_StatusTypeDef oled_init(void) {
 
 HAL_StatusTypeDef oled_write(uint8_t val) {
 	// CS and DC pins already managed outside of this function
-	
- 	uint8_t tx_buff[1];
-	tx_buff[0] = val;
-	HAL_StatusTypeDef write_status = HAL_SPI_Transmit(&hspi1, tx_buff, 1, 1000);
-	return write_status;
+	return spi_ll_transfer(hspi1.Instance, &val, NULL, 1);
 }
 
 HAL_StatusTypeDef oled_data(uint8_t data){
 	
-	HAL_GPIO_WritePin(OLED_DCL_GPIO_Port, OLED_DCL_Pin, GPIO_PIN_SET); // Set OLED DC high, since sending data
-	HAL_GPIO_WritePin(OLED_CS_GPIO_Port, OLED_CS_Pin, GPIO_PIN_RESET); // Set OLED cs low
-	//HAL_Delay(10);
+	LL_GPIO_SetOutputPin(OLED_DCL_GPIO_Port, OLED_DCL_Pin); // Set OLED DC high, since sending data
+	LL_GPIO_ResetOutputPin(OLED_CS_GPIO_Port, OLED_CS_Pin); // Set OLED cs low
 	
 	HAL_StatusTypeDef stat = oled_write(data);
 	
-	HAL_GPIO_WritePin(OLED_CS_GPIO_Port, OLED_CS_Pin, GPIO_PIN_SET); // Set OLED cs high again to disable
-
-	//HAL_Delay(10);
+	LL_GPIO_SetOutputPin(OLED_CS_GPIO_Port, OLED_CS_Pin); // Set OLED cs high again to disable
 	return stat;
 }
 
 HAL_StatusTypeDef oled_cmd(uint8_t cmd) {
+	return oled_cmds(&cmd, 1);
+}
+
+// Sends len command bytes under one CS low. The SSD1331 only needs DC and CS
+// set up for a few ns before SCK, so there is no delay around them.
+HAL_StatusTypeDef oled_cmds(const uint8_t *cmds, uint16_t len) {
 	
-	HAL_GPIO_WritePin(OLED_DCL_GPIO_Port, OLED_DCL_Pin, GPIO_PIN_RESET); // Set OLED DC low, since sending cmd
-	HAL_GPIO_WritePin(OLED_CS_GPIO_Port, OLED_CS_Pin, GPIO_PIN_RESET); // Set OLED cs low
-	HAL_Delay(1);
+	LL_GPIO_ResetOutputPin(OLED_DCL_GPIO_Port, OLED_DCL_Pin); // Set OLED DC low, since sending cmd
+	LL_GPIO_ResetOutputPin(OLED_CS_GPIO_Port, OLED_CS_Pin); // Set OLED cs low
 	
-	HAL_StatusTypeDef stat = oled_write(cmd);
+	HAL_StatusTypeDef stat = spi_ll_transfer(hspi1.Instance, cmds, NULL, len);
 	
-	HAL_GPIO_WritePin(OLED_CS_GPIO_Port, OLED_CS_Pin, GPIO_PIN_SET); // Set OLED cs high again to disable
-	//HAL_Delay(1);
+	LL_GPIO_SetOutputPin(OLED_CS_GPIO_Port, OLED_CS_Pin); // Set OLED cs high again to disable
 	return stat;
 }
 
@@ -224,35 +223,98 @@ void oled_drawRect(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t
 	
 }
 
-void oled_drawframe(uint16_t* pixel_buff){
+// Ring of RGB565 band buffers. One is being clocked out by DMA while the
+// others are rendered. Each buffer has its own SPI1 queue descriptor, and
+// buffer_band[] says which band it currently holds.
+static uint16_t band_buff[OLED_BAND_BUFFERS][OLED_BAND_PIXELS];
+static uint8_t buffer_band[OLED_BAND_BUFFERS];
+static Spi_Xfer_t band_xfer[OLED_BAND_BUFFERS];
+static Spi_Xfer_t window_xfer;
+static oled_band_fn frame_render_band;
+static volatile uint8_t frame_in_flight;
+
+uint32_t oled_tx_bytes; // bytes queued to the panel since boot
+
+static void oled_band_sent(Spi_Xfer_t *xfer, HAL_StatusTypeDef status);
+
+uint8_t oled_frame_busy(void) {
+	return frame_in_flight;
+}
+
+void oled_drawframe(oled_band_fn render_band){
 	//my_print_amsg("Draw frame\n");
-	// pixel_buff of OLED size
-	// each element contains the color to ship
+	// render_band produces the RGB565 pixels for one band at a time
 	
-	while (HAL_SPI_GetState(&hspi1) != HAL_SPI_STATE_READY){
+	while (frame_in_flight || !spi_queue_idle(&spi1_queue)){
 		//my_print_amsg("Waiting\n");
 	}
 
-	//HAL_TIM_Base_Start(&htim6);
-	oled_cmd(CMD_SET_COLUMN_ADDRESS);
-	oled_cmd(0);
-	oled_cmd(RGB_OLED_WIDTH-1);
-	//set row point
-	oled_cmd(CMD_SET_ROW_ADDRESS);
-	oled_cmd(0);
-	oled_cmd(RGB_OLED_HEIGHT-1);
-
-	HAL_GPIO_WritePin(OLED_DCL_GPIO_Port, OLED_DCL_Pin, GPIO_PIN_SET); // Set OLED DC high, since sending data
-	HAL_GPIO_WritePin(OLED_CS_GPIO_Port, OLED_CS_Pin, GPIO_PIN_RESET); // Set OLED cs low
-	HAL_Delay(1);
-	HAL_SPI_Transmit_DMA(&hspi1, (uint8_t*)pixel_buff, 12288);
+	static const uint8_t window[6] = {
+		CMD_SET_COLUMN_ADDRESS, 0, RGB_OLED_WIDTH-1,
+		CMD_SET_ROW_ADDRESS, 0, RGB_OLED_HEIGHT-1, //set row point
+	};
+	window_xfer = (Spi_Xfer_t){
+		.cs_port = OLED_CS_GPIO_Port, .cs_pin = OLED_CS_Pin,
+		.dc_port = OLED_DCL_GPIO_Port, .dc_pin = OLED_DCL_Pin, .dc = 0, // DC low, since sending cmd
+		.tx = window, .len = sizeof(window),
+	};
+	frame_render_band = render_band;
+
+	// Fill the whole ring before queueing any of it. Once band 0 is on the
+	// bus its completion renders the bands still to come, and render_band is
+	// not reentrant, so nothing may render here after the first submit.
+	for (uint8_t band = 0; band < OLED_BAND_BUFFERS && band < OLED_BAND_COUNT; band++) {
+		render_band(band, band_buff[band]);
+		buffer_band[band] = band;
+		band_xfer[band] = (Spi_Xfer_t){
+			.cs_port = OLED_CS_GPIO_Port, .cs_pin = OLED_CS_Pin,
+			.dc_port = OLED_DCL_GPIO_Port, .dc_pin = OLED_DCL_Pin, .dc = 1, // DC high, since sending data
+			.tx = (uint8_t*)band_buff[band], .len = sizeof(band_buff[0]),
+			.done = oled_band_sent,
+		};
+	}
+
+	// Queue the window and the ring in one go: a band that finished before
+	// the next was queued would have its completion queue a later band ahead
+	// of it. oled_band_sent also counts oled_tx_bytes, so it is added to here
+	// under the same mask.
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	frame_in_flight = 1;
+	spi_queue_submit(&spi1_queue, &window_xfer);
+	oled_tx_bytes += sizeof(window);
+	for (uint8_t band = 0; band < OLED_BAND_BUFFERS && band < OLED_BAND_COUNT; band++) {
+		spi_queue_submit(&spi1_queue, &band_xfer[band]);
+		oled_tx_bytes += sizeof(band_buff[0]);
+	}
+	__set_PRIMASK(primask);
 	//my_print_amsg("Done draw frame\n");
-	// Accelerometer cannot be interfaced with while DMA is transmitting (because OLED cs must be low)
-	// to work around this, we can pause the DMA and switch the CS values and grab the accelerometer value. 
 	return;
 }
 
+// Called from the SPI1 DMA completion interrupt once a band has been sent; the
+// queue has already started the next one. Each band is its own transfer, so
+// nothing past the last row is ever clocked out to the panel. A band that
+// failed to start is carried on from all the same, so the frame still ends.
+static void oled_band_sent(Spi_Xfer_t *xfer, HAL_StatusTypeDef status) {
+	(void)status;
+	uint8_t buf = xfer - band_xfer;
+	uint8_t done = buffer_band[buf];
 
+	if (done == OLED_BAND_COUNT - 1) {
+		frame_in_flight = 0; // Frame done
+#if M2P_ENABLE
+		m2p_photon();
+#endif
+		return;
+	}
 
-
-
+	// Reuse the buffer that just finished for the band furthest ahead
+	uint8_t ahead = done + OLED_BAND_BUFFERS;
+	if (ahead < OLED_BAND_COUNT) {
+		frame_render_band(ahead, band_buff[buf]);
+		buffer_band[buf] = ahead;
+		spi_queue_submit(&spi1_queue, xfer);
+		oled_tx_bytes += sizeof(band_buff[0]);
+	}
+}
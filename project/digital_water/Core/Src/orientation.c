@@ -0,0 +1,77 @@
+#include "orientation.h"
+#include <math.h>
+
+#if ORIENT_PROFILE && !defined(ORIENT_HOST)
+#include "prof.h"
+
+volatile uint32_t orient_update_cycles;  // last orient_update()
+volatile uint32_t orient_gravity_cycles; // last orient_gravity()
+
+#define PROFILE_START() uint32_t profile_start = DWT->CYCCNT
+#define PROFILE_END(total) (total) = DWT->CYCCNT - profile_start
+#else
+#define PROFILE_START()
+#define PROFILE_END(total)
+#endif
+
+// Filtered X/Y/Z counts, ORIENT_FILTER_FRAC fractional bits
+static int32_t filt[3];
+static uint8_t primed;
+
+void orient_reset(void)
+{
+	primed = 0;
+
+#if ORIENT_PROFILE && !defined(ORIENT_HOST)
+	prof_cycles_enable();
+#endif
+}
+
+// One raw sample, in counts (1 mg each at +-2 g)
+void orient_update(int16_t x, int16_t y, int16_t z)
+{
+	PROFILE_START();
+	int32_t raw[3] = {x, y, z};
+
+	for (int8_t i = 0; i < 3; i++) {
+		int32_t sample = raw[i] * (1 << ORIENT_FILTER_FRAC);
+		if (primed)
+			filt[i] += (sample - filt[i]) >> ORIENT_FILTER_SHIFT;
+		else
+			filt[i] = sample; // start from the first sample rather than from 0
+	}
+	primed = 1;
+	PROFILE_END(orient_update_cycles);
+}
+
+// Filtered counts, rounded, for printing
+void orient_filtered(int16_t *xyz)
+{
+	for (int8_t i = 0; i < 3; i++)
+		xyz[i] = (filt[i] + (1 << (ORIENT_FILTER_FRAC - 1))) >> ORIENT_FILTER_FRAC;
+}
+
+// Writes the unit gravity direction in simulation axes and returns 1, or
+// returns 0 and leaves gx/gy alone if no sample arrived yet or the board is
+// lying too flat for x/y to give a direction.
+uint8_t orient_gravity(float *gx, float *gy)
+{
+	if (!primed) return 0;
+
+	PROFILE_START();
+	const float scale = 1.0f / (1 << ORIENT_FILTER_FRAC);
+	float x = (float)filt[0] * scale;
+	float y = (float)filt[1] * scale;
+	float mag_sq = x * x + y * y;
+
+	if (mag_sq < (float)ORIENT_MIN_TILT * ORIENT_MIN_TILT) {
+		PROFILE_END(orient_gravity_cycles);
+		return 0;
+	}
+
+	float inv_mag = 1.0f / sqrtf(mag_sq);
+	*gx = -y * inv_mag;
+	*gy = x * inv_mag;
+	PROFILE_END(orient_gravity_cycles);
+	return 1;
+}
@@ -0,0 +1,128 @@
+#include "pcsamp.h"
+#include "telemetry.h"
+#include <string.h>
+
+#if PCSAMP_ENABLE
+
+#define TIMER_HZ 1000000 // TIM7 count rate
+#define PERIOD_US (TIMER_HZ / PCSAMP_HZ)
+
+volatile uint32_t pcsamp_samples;
+volatile uint32_t pcsamp_outside;
+volatile uint32_t pcsamp_in_handler;
+
+static uint16_t hist[PCSAMP_BUCKETS];
+static volatile uint8_t running;
+static volatile uint8_t stopped_full;
+static uint32_t dither = 1; // LFSR state
+
+void pcsamp_start(void)
+{
+  if (stopped_full) return;
+
+  __HAL_RCC_TIM7_CLK_ENABLE();
+  TIM7->CR1 = 0;
+  TIM7->PSC = apb1_timer_clock() / TIMER_HZ - 1;
+  TIM7->ARR = PERIOD_US - 1;
+  TIM7->EGR = TIM_EGR_UG; // load the prescaler
+  TIM7->SR = 0;
+  TIM7->DIER = TIM_DIER_UIE;
+  HAL_NVIC_SetPriority(TIM7_IRQn, 0, 2); // see irq_stats.h
+  HAL_NVIC_EnableIRQ(TIM7_IRQn);
+  running = 1;
+  TIM7->CR1 = TIM_CR1_CEN;
+}
+
+void pcsamp_stop(void)
+{
+  TIM7->CR1 = 0;
+  HAL_NVIC_DisableIRQ(TIM7_IRQn);
+  running = 0;
+}
+
+void pcsamp_reset(void)
+{
+  uint8_t was_running = running;
+
+  pcsamp_stop();
+  memset(hist, 0, sizeof(hist));
+  pcsamp_samples = 0;
+  pcsamp_outside = 0;
+  pcsamp_in_handler = 0;
+  stopped_full = 0;
+  if (was_running) pcsamp_start();
+}
+
+// Called from TIM7_IRQHandler with the interrupted context's exception frame
+// (r0-r3, r12, lr, pc, xpsr) and EXC_RETURN
+void pcsamp_isr(const uint32_t *frame, uint32_t exc_return)
+{
+  uint32_t pc = frame[6];
+  uint32_t offset = pc - FLASH_BASE;
+
+  TIM7->SR = 0;
+  // Next period up to PCSAMP_DITHER_US longer, from a 16-bit Galois LFSR
+  dither = (dither >> 1) ^ (-(dither & 1) & 0xB400u);
+  TIM7->ARR = PERIOD_US - 1 + (dither & PCSAMP_DITHER_US);
+
+  pcsamp_samples++;
+  // Bit 3 clear: returning to handler mode, so the sample is inside an ISR
+  if (!(exc_return & 8)) pcsamp_in_handler++;
+  if (offset >= PCSAMP_SPAN) {
+    pcsamp_outside++;
+    return;
+  }
+  uint16_t *count = &hist[offset >> PCSAMP_BUCKET_BITS];
+  if (++*count == UINT16_MAX) {
+    // Keep the shape rather than let one bucket clip
+    stopped_full = 1;
+    pcsamp_stop();
+  }
+}
+
+// Finds the stacked frame: MSP unless the interrupted code ran on PSP
+__attribute__((naked)) void TIM7_IRQHandler(void)
+{
+  __asm volatile(
+      "tst lr, #4      \n"
+      "ite eq          \n"
+      "mrseq r0, msp   \n"
+      "mrsne r0, psp   \n"
+      "mov r1, lr      \n"
+      "b pcsamp_isr    \n");
+}
+
+void pcsamp_dump(void)
+{
+  uint8_t was_running = running;
+  static Pcsamp_Pair_t pairs[PCSAMP_PAIRS_PER_PACKET]; // off the stack
+  uint8_t n = 0;
+
+  pcsamp_stop();
+  Pcsamp_Info_t info = {
+    .base = FLASH_BASE,
+    .samples = pcsamp_samples,
+    .outside = pcsamp_outside,
+    .in_handler = pcsamp_in_handler,
+    .rate_hz = PCSAMP_HZ,
+    .bucket_bits = PCSAMP_BUCKET_BITS,
+    .stopped_full = stopped_full,
+  };
+  // A packet that times out drops the rest of the dump
+  uint8_t sent = telem_send_wait(TELEM_TYPE_PCSAMP_INFO, &info, sizeof(info));
+
+  for (uint16_t i = 0; sent && i < PCSAMP_BUCKETS; i++) {
+    if (hist[i] == 0) continue;
+    pairs[n].bucket = i;
+    pairs[n].count = hist[i];
+    if (++n == PCSAMP_PAIRS_PER_PACKET) {
+      sent = telem_send_wait(TELEM_TYPE_PCSAMP_BUCKETS, pairs, n * sizeof(Pcsamp_Pair_t));
+      n = 0;
+    }
+  }
+  if (sent && n) telem_send_wait(TELEM_TYPE_PCSAMP_BUCKETS, pairs, n * sizeof(Pcsamp_Pair_t));
+
+  if (was_running) pcsamp_start();
+}
+
+#endif
@@ -0,0 +1,139 @@
+#include "prof.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef PROF_HOST
+#include <time.h>
+#endif
+
+#define SUB_BITS (PROF_SUB_BUCKETS == 1 ? 0 : PROF_SUB_BUCKETS == 2 ? 1 : PROF_SUB_BUCKETS == 4 ? 2 : 3)
+
+#ifndef PROF_HOST
+typedef char prof_trace_check[TRACE_OLED_DRAWFRAME - TRACE_ACCEL_POLL == PROF_SCOPE_COUNT - 1 ? 1 : -1];
+#endif
+
+Prof_Scope_t prof_scopes[PROF_SCOPE_COUNT];
+uint32_t prof_start[PROF_SCOPE_COUNT];
+
+static const char *const prof_names[PROF_SCOPE_COUNT] = {
+  [PROF_ACCEL_POLL] = "accel_poll",
+  [PROF_SIM_PARTICLE_STEP] = "Sim_Particle_Step",
+  [PROF_SIM_PUSH_APART] = "Sim_PushParticlesApart",
+  [PROF_SIM_TO_GRID] = "Sim_TransferVelocities(1)",
+  [PROF_SIM_GRID_STEP] = "Sim_Grid_Step",
+  [PROF_SIM_TO_PARTICLES] = "Sim_TransferVelocities(0)",
+  [PROF_RENDER_IMAGE] = "renderImage",
+  [PROF_OLED_DRAWFRAME] = "oled_drawframe",
+};
+
+#ifdef PROF_HOST
+uint32_t prof_host_cycles(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t ns = (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+  return (uint32_t)(ns * (PROF_HOST_HZ / 1000000) / 1000);
+}
+#endif
+
+static uint8_t prof_msb(uint32_t value)
+{
+#ifdef PROF_HOST
+  return 31 - __builtin_clz(value);
+#else
+  return 31 - __CLZ(value);
+#endif
+}
+
+// 0 under 2^PROF_MIN_BITS, then PROF_SUB_BUCKETS linear steps per octave
+static uint16_t prof_bucket(uint32_t cycles)
+{
+  if (cycles < 1u << PROF_MIN_BITS) return 0;
+  uint8_t octave = prof_msb(cycles);
+  if (octave >= PROF_MIN_BITS + PROF_OCTAVES) return PROF_BUCKETS - 1;
+  uint32_t sub = (cycles >> (octave - SUB_BITS)) & (PROF_SUB_BUCKETS - 1);
+  return 1 + (octave - PROF_MIN_BITS) * PROF_SUB_BUCKETS + sub;
+}
+
+// Largest value that lands in a bucket
+static uint32_t prof_bucket_top(uint16_t bucket)
+{
+  if (bucket == 0) return (1u << PROF_MIN_BITS) - 1;
+  if (bucket == PROF_BUCKETS - 1) return UINT32_MAX;
+  uint8_t octave = PROF_MIN_BITS + (bucket - 1) / PROF_SUB_BUCKETS;
+  uint32_t sub = (bucket - 1) % PROF_SUB_BUCKETS;
+  return ((PROF_SUB_BUCKETS + sub + 1) << (octave - SUB_BITS)) - 1;
+}
+
+#ifndef PROF_HOST
+void prof_cycles_enable(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+#endif
+
+void prof_init(void)
+{
+  prof_cycles_enable();
+  prof_reset();
+}
+
+void prof_reset(void)
+{
+  memset(prof_scopes, 0, sizeof(prof_scopes));
+}
+
+void prof_record(uint8_t scope, uint32_t cycles)
+{
+  Prof_Scope_t *s = &prof_scopes[scope];
+  uint16_t bucket = prof_bucket(cycles);
+
+  if (s->count == 0 || cycles < s->min) s->min = cycles;
+  if (cycles > s->max) s->max = cycles;
+  s->count++;
+  s->sum += cycles;
+
+  // A full bucket halves the whole histogram, keeping its shape
+  if (s->hist[bucket] == UINT16_MAX) {
+    s->hist_total = 0;
+    for (uint16_t i = 0; i < PROF_BUCKETS; i++) {
+      s->hist[i] >>= 1;
+      s->hist_total += s->hist[i];
+    }
+  }
+  s->hist[bucket]++;
+  s->hist_total++;
+}
+
+uint32_t prof_p99(uint8_t scope)
+{
+  const Prof_Scope_t *s = &prof_scopes[scope];
+  uint32_t above = s->hist_total / 100; // samples allowed over the result
+  uint32_t seen = 0;
+
+  if (s->count == 0) return 0;
+  for (uint16_t i = PROF_BUCKETS; i-- > 0;) {
+    seen += s->hist[i];
+    if (seen > above) {
+      uint32_t top = prof_bucket_top(i);
+      return top < s->max ? top : s->max;
+    }
+  }
+  return s->max;
+}
+
+void prof_dump(void)
+{
+  char line[96];
+
+  PROF_PRINT("scope                        count        min        avg        max        p99\n");
+  for (uint8_t i = 0; i < PROF_SCOPE_COUNT; i++) {
+    const Prof_Scope_t *s = &prof_scopes[i];
+    uint32_t avg = s->count ? (uint32_t)(s->sum / s->count) : 0;
+    snprintf(line, sizeof(line), "%-26s %8lu %10lu %10lu %10lu %10lu\n", prof_names[i],
+             (unsigned long)s->count, (unsigned long)s->min, (unsigned long)avg,
+             (unsigned long)s->max, (unsigned long)prof_p99(i));
+    PROF_PRINT(line);
+  }
+}
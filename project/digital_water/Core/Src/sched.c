@@ -0,0 +1,157 @@
+#include "sched.h"
+#include "prof.h"
+#include <stdio.h>
+
+#ifdef SCHED_HOST
+uint32_t sched_host_ms;
+uint32_t sched_host_cycles;
+#define SCHED_TICK() sched_host_ms
+#define SCHED_NOW() sched_host_cycles
+#define SCHED_CORE_HZ SCHED_HOST_HZ
+// One thread: nothing to mask, and the idle hook delivers the releases
+#define SCHED_MASK() 0
+#define SCHED_RESTORE(primask) ((void)(primask))
+#define SCHED_WFI() \
+  do { \
+    if (!sched_host_idle()) return; \
+  } while (0)
+#define TRACE_BEGIN(event, arg) ((void)0)
+#define TRACE_END(event, arg) ((void)0)
+#else
+#include "trace.h"
+#define SCHED_TICK() HAL_GetTick()
+#define SCHED_NOW() (DWT->CYCCNT)
+#define SCHED_CORE_HZ SystemCoreClock
+#define SCHED_MASK() sched_mask()
+#define SCHED_RESTORE(primask) __set_PRIMASK(primask)
+#define SCHED_WFI() __WFI()
+
+static uint32_t sched_mask(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  return primask;
+}
+#endif
+
+static Sched_Task_t tasks[SCHED_TASK_COUNT];
+static uint64_t idle_cycles;
+
+void sched_task_init(uint8_t task, const char *name, Sched_Fn_t run, uint8_t priority, uint16_t period_ms,
+                     uint16_t deadline_ms)
+{
+  Sched_Task_t *t = &tasks[task];
+
+  t->name = name;
+  t->run = run;
+  t->priority = priority;
+  t->period_ms = period_ms;
+  t->deadline_ms = deadline_ms;
+  t->next = SCHED_TICK();
+}
+
+void sched_signal(uint8_t task)
+{
+  Sched_Task_t *t = &tasks[task];
+  // Handlers of different priorities may signal the same task
+  uint32_t primask = SCHED_MASK();
+  if (t->ready) {
+    t->overruns++;
+  } else {
+    t->release = SCHED_TICK();
+    t->ready = 1;
+  }
+  SCHED_RESTORE(primask);
+}
+
+// Releases the periodic tasks that are due, then picks the one to run and
+// takes its release. Call with interrupts masked.
+static Sched_Task_t *sched_next(void)
+{
+  uint32_t now = SCHED_TICK();
+  Sched_Task_t *best = 0;
+
+  for (uint8_t i = 0; i < SCHED_TASK_COUNT; i++) {
+    Sched_Task_t *t = &tasks[i];
+
+    if (t->period_ms && (int32_t)(now - t->next) >= 0) {
+      if (t->ready) {
+        t->overruns++;
+      } else {
+        t->release = t->next;
+        t->ready = 1;
+      }
+      t->next += t->period_ms;
+      if ((int32_t)(now - t->next) >= 0) t->next = now + t->period_ms;
+    }
+    if (t->ready && t->run && (!best || t->priority < best->priority)) best = t;
+  }
+  if (best) best->ready = 0;
+  return best;
+}
+
+void sched_run(void)
+{
+  prof_cycles_enable();
+
+  for (;;) {
+    uint32_t primask = SCHED_MASK();
+    Sched_Task_t *t = sched_next();
+    if (!t) {
+      // Masked from the check to WFI so a release landing in between is not
+      // slept through; WFI still returns on the pending interrupt
+      uint32_t start = SCHED_NOW();
+      TRACE_BEGIN(TRACE_IDLE, 0);
+      SCHED_WFI();
+      SCHED_RESTORE(primask);
+      TRACE_END(TRACE_IDLE, 0);
+      idle_cycles += SCHED_NOW() - start;
+      continue;
+    }
+    uint32_t release = t->release;
+    SCHED_RESTORE(primask);
+
+    uint32_t start = SCHED_NOW();
+    TRACE_BEGIN(TRACE_TASK, t - tasks);
+    t->run();
+    TRACE_END(TRACE_TASK, t - tasks);
+    uint32_t cycles = SCHED_NOW() - start;
+    uint32_t response = SCHED_TICK() - release;
+
+    t->runs++;
+    t->sum_cycles += cycles;
+    if (cycles > t->max_cycles) t->max_cycles = cycles;
+    if (response > t->max_response) t->max_response = response;
+    if (t->deadline_ms && response > t->deadline_ms) t->misses++;
+  }
+}
+
+void sched_dump(void)
+{
+  char line[96];
+  uint32_t per_us = SCHED_CORE_HZ / 1000000;
+  uint64_t busy = 0;
+
+  PROF_PRINT("task        pri period deadline     runs   avg us   max us  resp ms   misses overruns\n");
+  for (uint8_t i = 0; i < SCHED_TASK_COUNT; i++) {
+    const Sched_Task_t *t = &tasks[i];
+    uint32_t avg = t->runs ? (uint32_t)(t->sum_cycles / t->runs) : 0;
+
+    if (!t->run) continue; // never set up
+    busy += t->sum_cycles;
+    snprintf(line, sizeof(line), "%-10s %4u %6u %8u %8lu %8lu %8lu %8lu %8lu %8lu\n", t->name,
+             (unsigned)t->priority, (unsigned)t->period_ms, (unsigned)t->deadline_ms, (unsigned long)t->runs,
+             (unsigned long)(avg / per_us), (unsigned long)(t->max_cycles / per_us),
+             (unsigned long)t->max_response, (unsigned long)t->misses, (unsigned long)t->overruns);
+    PROF_PRINT(line);
+  }
+  if (busy + idle_cycles) {
+    snprintf(line, sizeof(line), "idle %lu%%\n", (unsigned long)(idle_cycles * 100 / (busy + idle_cycles)));
+    PROF_PRINT(line);
+  }
+}
+
+const Sched_Task_t *sched_task(uint8_t task)
+{
+  return &tasks[task];
+}
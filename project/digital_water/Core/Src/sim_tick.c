@@ -0,0 +1,73 @@
+#include "sim_tick.h"
+#include "fluid_sim.h"
+#include "irq_stats.h"
+#include "sched.h"
+
+#define TICK_PERIOD (SIM_TICK_COUNTER_HZ / SIM_PHYSICS_FPS)
+#if TICK_PERIOD > 65536
+#error "TIM6 period over 16 bits: lower SIM_TICK_COUNTER_HZ"
+#endif
+
+extern TIM_HandleTypeDef htim6;
+
+volatile uint32_t sim_ticks_late;
+volatile uint32_t sim_ticks_dropped;
+
+static volatile uint32_t ticks; // TIM6 overflows since sim_tick_start
+static uint32_t ticks_taken;    // ticks stepped or dropped
+
+void sim_tick_start(void)
+{
+  HAL_TIM_Base_Stop_IT(&htim6);
+  htim6.Init.Prescaler = apb1_timer_clock() / SIM_TICK_COUNTER_HZ - 1;
+  htim6.Init.Period = TICK_PERIOD - 1;
+  HAL_TIM_Base_Init(&htim6);
+  // Init sets the update flag loading the prescaler; don't count it
+  __HAL_TIM_CLEAR_FLAG(&htim6, TIM_FLAG_UPDATE);
+
+  ticks = 0;
+  ticks_taken = 0;
+  HAL_TIM_Base_Start_IT(&htim6);
+}
+
+void sim_tick_stop(void)
+{
+  HAL_TIM_Base_Stop_IT(&htim6);
+}
+
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
+{
+  if (htim != &htim6) return;
+  ticks++;
+  sched_signal(SCHED_TASK_PHYSICS);
+#if IRQ_STATS_ENABLE
+  // The counter restarted from 0 at the update event, so it reads how long
+  // the interrupt took to be serviced, rounded down to a count
+  uint32_t step = SystemCoreClock / SIM_TICK_COUNTER_HZ;
+  irq_stats_latency(IRQ_STATS_TIM6, __HAL_TIM_GET_COUNTER(&htim6) * step, step);
+#endif
+}
+
+uint8_t sim_tick_take(void)
+{
+  uint32_t now = ticks;
+  uint32_t due = now - ticks_taken;
+
+  ticks_taken = now;
+  if (due > SIM_MAX_CATCHUP_STEPS) {
+    sim_ticks_dropped += due - SIM_MAX_CATCHUP_STEPS;
+    due = SIM_MAX_CATCHUP_STEPS;
+  }
+  if (due > 1) sim_ticks_late += due - 1;
+  return due;
+}
+
+float sim_tick_alpha(void)
+{
+  uint32_t count = __HAL_TIM_GET_COUNTER(&htim6);
+
+  // A tick that landed after sim_tick_take() has not been stepped yet: the
+  // latest state is already as old as it can be
+  if (ticks != ticks_taken) return 1.0f;
+  return (float)count / TICK_PERIOD;
+}
@@ -0,0 +1,71 @@
+#include "spi_ll.h"
+#include "prof.h"
+#include <stdio.h>
+
+static uint8_t spi_ll_wait(SPI_TypeDef *spi, uint32_t flag, uint32_t state)
+{
+	for (uint32_t loops = SPI_LL_TIMEOUT_LOOPS; loops; loops--) {
+		if ((spi->SR & flag) == state) return 1;
+	}
+	return 0;
+}
+
+// Full duplex transfer of len bytes, one byte in flight at a time. tx may be
+// NULL to clock out zeros and rx NULL to drop what comes back. Returns once
+// the last byte has left the shift register.
+HAL_StatusTypeDef spi_ll_transfer(SPI_TypeDef *spi, const uint8_t *tx, uint8_t *rx, uint16_t len)
+{
+	// HAL only sets SPE on its first transfer
+	if (!LL_SPI_IsEnabled(spi)) LL_SPI_Enable(spi);
+
+	// Drop anything a transmit-only DMA left in the receiver
+	LL_SPI_ClearFlag_OVR(spi);
+
+	for (uint16_t i = 0; i < len; i++) {
+		if (!spi_ll_wait(spi, SPI_SR_TXE, SPI_SR_TXE)) return HAL_TIMEOUT;
+		LL_SPI_TransmitData8(spi, tx ? tx[i] : 0);
+		if (!spi_ll_wait(spi, SPI_SR_RXNE, SPI_SR_RXNE)) return HAL_TIMEOUT;
+		uint8_t val = LL_SPI_ReceiveData8(spi);
+		if (rx) rx[i] = val;
+	}
+
+	if (!spi_ll_wait(spi, SPI_SR_BSY, 0)) return HAL_TIMEOUT;
+	return HAL_OK;
+}
+
+#if SPI_LL_BENCH
+// Prints the mean cycles per transaction (CS low, len bytes, CS high) through
+// HAL_GPIO_WritePin + HAL_SPI_TransmitReceive and through BSRR +
+// spi_ll_transfer. tx must be harmless to repeat on that device.
+void spi_ll_benchmark(const char *name, SPI_HandleTypeDef *hspi, GPIO_TypeDef *cs_port,
+                      uint16_t cs_pin, const uint8_t *tx, uint16_t len)
+{
+	const uint16_t runs = 64;
+	uint8_t rx[16];
+	char msg[100];
+
+	if (len > sizeof(rx)) return;
+
+	prof_cycles_enable();
+
+	uint32_t start = DWT->CYCCNT;
+	for (uint16_t i = 0; i < runs; i++) {
+		HAL_GPIO_WritePin(cs_port, cs_pin, GPIO_PIN_RESET);
+		HAL_SPI_TransmitReceive(hspi, (uint8_t *)tx, rx, len, 1000);
+		HAL_GPIO_WritePin(cs_port, cs_pin, GPIO_PIN_SET);
+	}
+	uint32_t hal_cycles = (DWT->CYCCNT - start) / runs;
+
+	start = DWT->CYCCNT;
+	for (uint16_t i = 0; i < runs; i++) {
+		LL_GPIO_ResetOutputPin(cs_port, cs_pin);
+		spi_ll_transfer(hspi->Instance, tx, rx, len);
+		LL_GPIO_SetOutputPin(cs_port, cs_pin);
+	}
+	uint32_t ll_cycles = (DWT->CYCCNT - start) / runs;
+
+	sprintf(msg, "%s %u byte transaction: HAL %lu cycles, LL %lu cycles\n", name,
+	        (unsigned)len, (unsigned long)hal_cycles, (unsigned long)ll_cycles);
+	print_msg(msg);
+}
+#endif
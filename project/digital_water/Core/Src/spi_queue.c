@@ -0,0 +1,103 @@
+#include "spi_queue.h"
+#include "stm32f4xx_ll_gpio.h"
+
+extern SPI_HandleTypeDef hspi1;
+extern SPI_HandleTypeDef hspi3;
+
+Spi_Queue_t spi1_queue = {&hspi1, NULL, NULL, NULL};
+Spi_Queue_t spi3_queue = {&hspi3, NULL, NULL, NULL};
+
+static Spi_Queue_t *const queues[] = {&spi1_queue, &spi3_queue};
+
+// Starts the head descriptor if the bus is free. Runs with interrupts masked
+// or from the completion interrupt.
+static void spi_queue_start(Spi_Queue_t *queue)
+{
+  while (!queue->active && queue->head) {
+    Spi_Xfer_t *xfer = queue->head;
+    queue->head = xfer->next;
+    if (!queue->head) queue->tail = NULL;
+
+    xfer->state = SPI_XFER_ACTIVE;
+    queue->active = xfer;
+
+    if (xfer->dc_port) {
+      if (xfer->dc) LL_GPIO_SetOutputPin(xfer->dc_port, xfer->dc_pin);
+      else LL_GPIO_ResetOutputPin(xfer->dc_port, xfer->dc_pin);
+    }
+    LL_GPIO_ResetOutputPin(xfer->cs_port, xfer->cs_pin);
+
+    HAL_StatusTypeDef status;
+    if (xfer->rx)
+      status = HAL_SPI_TransmitReceive_DMA(queue->hspi, (uint8_t *)xfer->tx, xfer->rx, xfer->len);
+    else
+      status = HAL_SPI_Transmit_DMA(queue->hspi, (uint8_t *)xfer->tx, xfer->len);
+    if (status == HAL_OK) return;
+
+    // Did not start; report it and try the next one
+    LL_GPIO_SetOutputPin(xfer->cs_port, xfer->cs_pin);
+    queue->active = NULL;
+    xfer->state = SPI_XFER_IDLE;
+    if (xfer->done) xfer->done(xfer, status);
+  }
+}
+
+// Appends xfer and starts it if the bus is idle. Returns HAL_BUSY if xfer is
+// already queued or on the bus. Safe from interrupts and the main loop.
+HAL_StatusTypeDef spi_queue_submit(Spi_Queue_t *queue, Spi_Xfer_t *xfer)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  if (xfer->state != SPI_XFER_IDLE) {
+    __set_PRIMASK(primask);
+    return HAL_BUSY;
+  }
+  xfer->state = SPI_XFER_QUEUED;
+  xfer->next = NULL;
+  if (queue->tail) queue->tail->next = xfer;
+  else queue->head = xfer;
+  queue->tail = xfer;
+
+  spi_queue_start(queue);
+  __set_PRIMASK(primask);
+  return HAL_OK;
+}
+
+uint8_t spi_queue_idle(Spi_Queue_t *queue)
+{
+  return !queue->active && !queue->head;
+}
+
+static void spi_queue_complete(SPI_HandleTypeDef *hspi, HAL_StatusTypeDef status)
+{
+  for (uint8_t i = 0; i < sizeof(queues) / sizeof(queues[0]); i++) {
+    Spi_Queue_t *queue = queues[i];
+    if (queue->hspi != hspi || !queue->active) continue;
+
+    Spi_Xfer_t *xfer = queue->active;
+    LL_GPIO_SetOutputPin(xfer->cs_port, xfer->cs_pin);
+    queue->active = NULL;
+    xfer->state = SPI_XFER_IDLE;
+
+    // Next transfer first, so the callback runs while the bus is busy
+    spi_queue_start(queue);
+    if (xfer->done) xfer->done(xfer, status);
+    return;
+  }
+}
+
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+  spi_queue_complete(hspi, HAL_OK);
+}
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+  spi_queue_complete(hspi, HAL_OK);
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
+{
+  spi_queue_complete(hspi, HAL_ERROR);
+}
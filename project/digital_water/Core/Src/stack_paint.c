@@ -0,0 +1,31 @@
+#include "stack_paint.h"
+
+#if STACK_PAINT_ENABLE
+
+// armlink bounds of the STACK section from startup_stm32f446xx.s
+extern uint32_t stack_base __asm("STACK$$Base");
+extern uint32_t stack_limit __asm("STACK$$Limit");
+
+void stack_paint(void)
+{
+  uint32_t *word = &stack_base;
+  // Leave a little under the live frame for this function's own use
+  uint32_t *end = (uint32_t *)(__get_MSP() - 32);
+
+  while (word < end) *word++ = STACK_PAINT_WORD;
+}
+
+uint32_t stack_size(void)
+{
+  return (uint32_t)((uint8_t *)&stack_limit - (uint8_t *)&stack_base);
+}
+
+uint32_t stack_high_water(void)
+{
+  const uint32_t *word = &stack_base;
+
+  while (word < &stack_limit && *word == STACK_PAINT_WORD) word++;
+  return (uint32_t)((uint8_t *)&stack_limit - (const uint8_t *)word);
+}
+
+#endif
@@ -23,6 +23,9 @@
 #include <stdio.h>
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "accelerometer.h"
+#include "irq_stats.h"
+#include "sched.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -56,7 +59,9 @@
 /* USER CODE END 0 */
 
 /* External variables --------------------------------------------------------*/
+extern PCD_HandleTypeDef hpcd_USB_OTG_FS;
 extern DMA_HandleTypeDef hdma_spi1_tx;
+extern DMA_HandleTypeDef hdma_spi3_rx;
 extern DMA_HandleTypeDef hdma_spi3_tx;
 extern TIM_HandleTypeDef htim6;
 extern DMA_HandleTypeDef hdma_usart3_tx;
@@ -206,17 +211,31 @@ void SysTick_Handler(void)
 /* please refer to the startup file (startup_stm32f4xx.s).                    */
 /******************************************************************************/
 
+/**
+  * @brief This function handles DMA1 stream0 global interrupt.
+  */
+void DMA1_Stream0_IRQHandler(void)
+{
+  /* USER CODE BEGIN DMA1_Stream0_IRQn 0 */
+  IRQ_STATS_ENTER(IRQ_STATS_DMA1_STREAM0);
+  /* USER CODE END DMA1_Stream0_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_spi3_rx);
+  /* USER CODE BEGIN DMA1_Stream0_IRQn 1 */
+  IRQ_STATS_EXIT(IRQ_STATS_DMA1_STREAM0, 0);
+  /* USER CODE END DMA1_Stream0_IRQn 1 */
+}
+
 /**
   * @brief This function handles DMA1 stream3 global interrupt.
   */
 void DMA1_Stream3_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Stream3_IRQn 0 */
-
+  IRQ_STATS_ENTER(IRQ_STATS_DMA1_STREAM3);
   /* USER CODE END DMA1_Stream3_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_usart3_tx);
   /* USER CODE BEGIN DMA1_Stream3_IRQn 1 */
-
+  IRQ_STATS_EXIT(IRQ_STATS_DMA1_STREAM3, 0);
   /* USER CODE END DMA1_Stream3_IRQn 1 */
 }
 
@@ -226,11 +245,11 @@ void DMA1_Stream3_IRQHandler(void)
 void DMA1_Stream5_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Stream5_IRQn 0 */
-
+  IRQ_STATS_ENTER(IRQ_STATS_DMA1_STREAM5);
   /* USER CODE END DMA1_Stream5_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_spi3_tx);
   /* USER CODE BEGIN DMA1_Stream5_IRQn 1 */
-
+  IRQ_STATS_EXIT(IRQ_STATS_DMA1_STREAM5, 0);
   /* USER CODE END DMA1_Stream5_IRQn 1 */
 }
 
@@ -240,11 +259,11 @@ void DMA1_Stream5_IRQHandler(void)
 void USART3_IRQHandler(void)
 {
   /* USER CODE BEGIN USART3_IRQn 0 */
-
+  IRQ_STATS_ENTER(IRQ_STATS_USART3);
   /* USER CODE END USART3_IRQn 0 */
   HAL_UART_IRQHandler(&huart3);
   /* USER CODE BEGIN USART3_IRQn 1 */
-
+  IRQ_STATS_EXIT(IRQ_STATS_USART3, 0);
   /* USER CODE END USART3_IRQn 1 */
 }
 
@@ -254,36 +273,38 @@ void USART3_IRQHandler(void)
 void EXTI15_10_IRQHandler(void)
 {
   /* USER CODE BEGIN EXTI15_10_IRQn 0 */
-
+	IRQ_STATS_ENTER(IRQ_STATS_EXTI15_10);
 	 
 	 if (__HAL_GPIO_EXTI_GET_FLAG(USER_Btn_Pin)) {
 		 btn_press = 1;
+		 sched_signal(SCHED_TASK_TELEMETRY);
 	 }
+	 uint8_t accel_int = __HAL_GPIO_EXTI_GET_FLAG(ACCEL_INT1_Pin) != 0;
 
   /* USER CODE END EXTI15_10_IRQn 0 */
   HAL_GPIO_EXTI_IRQHandler(USER_Btn_Pin);
   HAL_GPIO_EXTI_IRQHandler(ACCEL_INT1_Pin);
   /* USER CODE BEGIN EXTI15_10_IRQn 1 */
-
+	// FIFO watermark or DATA_READY: start the DMA read, samples land in the
+	// accelerometer ring once it completes
+	if (accel_int) {
+		accel_int1_handler();
+	}
+	IRQ_STATS_EXIT(IRQ_STATS_EXTI15_10, accel_int);
   /* USER CODE END EXTI15_10_IRQn 1 */
 }
 
 /**
   * @brief This function handles TIM6 global interrupt and DAC1, DAC2 underrun error interrupts.
   */
-extern int overflow;
 void TIM6_DAC_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM6_DAC_IRQn 0 */
-	//char msg[100];
-	//sprintf(msg, "Overflowed \n");
-	//print_msg(msg);
-	overflow++;
-
+  IRQ_STATS_ENTER(IRQ_STATS_TIM6);
   /* USER CODE END TIM6_DAC_IRQn 0 */
   HAL_TIM_IRQHandler(&htim6);
   /* USER CODE BEGIN TIM6_DAC_IRQn 1 */
-
+  IRQ_STATS_EXIT(IRQ_STATS_TIM6, 0);
   /* USER CODE END TIM6_DAC_IRQn 1 */
 }
 
@@ -293,23 +314,28 @@ void TIM6_DAC_IRQHandler(void)
 void DMA2_Stream3_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA2_Stream3_IRQn 0 */
-
-		//  One frame via DMA calculatio
-		/*HAL_TIM_Base_Stop(&htim6);
-		uint16_t time = __HAL_TIM_GET_COUNTER(&htim6);
-		sprintf(msg, "Time: %d\n", time);
-		print_msg(msg);
-		while(1)
-			;
-		*/
-
+  IRQ_STATS_ENTER(IRQ_STATS_DMA2_STREAM3);
   /* USER CODE END DMA2_Stream3_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_spi1_tx);
   /* USER CODE BEGIN DMA2_Stream3_IRQn 1 */
-
+  IRQ_STATS_EXIT(IRQ_STATS_DMA2_STREAM3, 0);
   /* USER CODE END DMA2_Stream3_IRQn 1 */
 }
 
+/**
+  * @brief This function handles USB On The Go FS global interrupt.
+  */
+void OTG_FS_IRQHandler(void)
+{
+  /* USER CODE BEGIN OTG_FS_IRQn 0 */
+  IRQ_STATS_ENTER(IRQ_STATS_OTG_FS);
+  /* USER CODE END OTG_FS_IRQn 0 */
+  HAL_PCD_IRQHandler(&hpcd_USB_OTG_FS);
+  /* USER CODE BEGIN OTG_FS_IRQn 1 */
+  IRQ_STATS_EXIT(IRQ_STATS_OTG_FS, 0);
+  /* USER CODE END OTG_FS_IRQn 1 */
+}
+
 /* USER CODE BEGIN 1 */
 
 /* USER CODE END 1 */
@@ -0,0 +1,134 @@
+#include "telemetry.h"
+#include "dlog.h"
+#include "fluid_sim.h"
+#include "oled.h"
+#include "usb_cdc.h"
+#include "sim_tick.h"
+#include "governor.h"
+#include "prof.h"
+
+typedef char telem_frame_size_check[sizeof(Telem_Frame_t) == 4 * (8 + TELEM_STAGE_COUNT) + 12 ? 1 : -1];
+
+uint32_t telem_dumps_cut;
+
+static uint32_t frame_count;
+static uint32_t frame_start;
+static uint32_t stage_start;
+static uint32_t stage_cycles[TELEM_STAGE_COUNT];
+static uint32_t last_oled_bytes;
+
+void telem_init(void)
+{
+  prof_cycles_enable();
+  last_oled_bytes = oled_tx_bytes;
+  frame_start = DWT->CYCCNT;
+}
+
+uint32_t telem_frame_work(void)
+{
+  uint32_t work = 0;
+
+  for (uint8_t i = 0; i < TELEM_STAGE_COUNT; i++) work += stage_cycles[i];
+  return work;
+}
+
+void telem_stage_begin(void)
+{
+  stage_start = DWT->CYCCNT;
+}
+
+void telem_stage_end(uint8_t stage)
+{
+  uint32_t now = DWT->CYCCNT;
+  stage_cycles[stage] += now - stage_start;
+  stage_start = now;
+}
+
+static uint16_t telem_crc(uint16_t crc, const uint8_t *data, uint16_t len)
+{
+  while (len--) {
+    crc ^= (uint16_t)*data++ << 8;
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// Frames one packet and queues it on USB if a host has the port open,
+// otherwise on the UART ring
+uint8_t telem_send(uint8_t type, const void *payload, uint8_t len)
+{
+  static uint8_t packet[2 + 2 + 255 + 2]; // main loop only; kept off the stack
+
+  packet[0] = TELEM_SYNC & 0xFF;
+  packet[1] = TELEM_SYNC >> 8;
+  packet[2] = type;
+  packet[3] = len;
+  memcpy(&packet[4], payload, len);
+  uint16_t crc = telem_crc(0xFFFF, &packet[2], 2 + len);
+  packet[4 + len] = crc & 0xFF;
+  packet[5 + len] = crc >> 8;
+#if USB_CDC_ENABLE
+  if (usb_cdc_is_open()) return usb_cdc_write(packet, 6 + len);
+#endif
+  dlog_raw(packet, 6 + len);
+  return 1;
+}
+
+uint8_t telem_send_wait(uint8_t type, const void *payload, uint8_t len)
+{
+#if USB_CDC_ENABLE
+  if (!usb_cdc_is_open()) dlog_flush();
+#else
+  dlog_flush();
+#endif
+  uint32_t start = HAL_GetTick();
+  while (!telem_send(type, payload, len)) {
+    if (HAL_GetTick() - start >= TELEM_WAIT_MS) {
+      telem_dumps_cut++;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Starts the next frame here rather than at the render release, so the sensor
+// and physics runs in between are charged to a frame
+static void telem_frame_restart(void)
+{
+  frame_start = DWT->CYCCNT;
+  for (uint8_t i = 0; i < TELEM_STAGE_COUNT; i++) stage_cycles[i] = 0;
+}
+
+void telem_frame_end(uint16_t accel_samples, uint16_t physics_steps)
+{
+#if TELEM_ENABLE
+  uint32_t frame_cycles = DWT->CYCCNT - frame_start;
+  uint32_t oled_bytes = oled_tx_bytes - last_oled_bytes;
+  last_oled_bytes = oled_tx_bytes;
+
+  // USB keeps up with every frame
+  if (frame_count++ % TELEM_DECIMATION && !usb_cdc_is_open()) {
+    telem_frame_restart();
+    return;
+  }
+
+  Telem_Frame_t record;
+  record.frame = frame_count - 1;
+  record.tick_ms = HAL_GetTick();
+  for (uint8_t i = 0; i < TELEM_STAGE_COUNT; i++) record.stage_cycles[i] = stage_cycles[i];
+  record.frame_cycles = frame_cycles;
+  record.oled_bytes = oled_bytes;
+  record.gravity_x = GravityVector.x;
+  record.gravity_y = GravityVector.y;
+  Sim_ParticleSpeeds(&record.mean_speed, &record.max_speed);
+  record.accel_samples = accel_samples;
+  record.physics_steps = physics_steps;
+  record.ticks_late = sim_ticks_late;
+  record.ticks_dropped = sim_ticks_dropped;
+  record.gov_level = gov_level;
+  record.frames_skipped = gov_frames_skipped;
+  telem_send(TELEM_TYPE_FRAME, &record, sizeof(record));
+#endif
+  telem_frame_restart();
+}
@@ -0,0 +1,68 @@
+#include "trace.h"
+#include "prof.h"
+#include "telemetry.h"
+
+#if TRACE_ENABLE
+
+static Trace_Record_t ring[TRACE_RECORDS];
+static volatile uint32_t written; // slots claimed since trace_reset()
+static volatile uint8_t recording;
+
+void trace_init(void)
+{
+  prof_cycles_enable();
+  trace_reset();
+}
+
+// Main loop only. A handler's trace_write() runs to completion before this
+// resumes, so the index can go back to 0 without holding writers off.
+void trace_reset(void)
+{
+  written = 0;
+  recording = 1;
+}
+
+void trace_write(uint8_t event, uint8_t phase, uint16_t arg)
+{
+  uint32_t cycles = DWT->CYCCNT;
+  uint32_t slot;
+
+  if (!recording) return;
+  // An interrupt between the two clears the reservation and STREX retries
+  do {
+    slot = __LDREXW((volatile uint32_t *)&written);
+  } while (__STREXW(slot + 1, (volatile uint32_t *)&written));
+
+  Trace_Record_t *r = &ring[slot & (TRACE_RECORDS - 1)];
+  r->cycles = cycles;
+  r->event = event;
+  r->phase = phase;
+  r->arg = arg;
+}
+
+void trace_dump(void)
+{
+  recording = 0;
+
+  uint32_t count = written;
+  uint32_t first = count > TRACE_RECORDS ? count - TRACE_RECORDS : 0;
+  Trace_Info_t info = {
+    .core_hz = SystemCoreClock,
+    .written = count,
+    .records = TRACE_RECORDS,
+  };
+  // A packet that times out drops the rest of the dump
+  uint8_t sent = telem_send_wait(TELEM_TYPE_TRACE_INFO, &info, sizeof(info));
+
+  while (sent && first < count) {
+    static Trace_Record_t chunk[TRACE_RECORDS_PER_PACKET]; // off the stack
+    uint8_t n = 0;
+    for (; n < TRACE_RECORDS_PER_PACKET && first < count; n++, first++)
+      chunk[n] = ring[first & (TRACE_RECORDS - 1)];
+    sent = telem_send_wait(TELEM_TYPE_TRACE, chunk, n * sizeof(Trace_Record_t));
+  }
+
+  trace_reset();
+}
+
+#endif
@@ -0,0 +1,375 @@
+#include "usb_cdc.h"
+#include <string.h>
+
+extern PCD_HandleTypeDef hpcd_USB_OTG_FS;
+
+#define EP0_SIZE 64
+#define CDC_IN_EP 0x81
+#define CDC_OUT_EP 0x01
+#define CDC_CMD_EP 0x82
+#define CDC_CMD_SIZE 8
+
+// FIFO RAM is 320 words on OTG_FS
+#define FIFO_RX_WORDS 0x80
+#define FIFO_TX0_WORDS 0x20
+#define FIFO_TX1_WORDS 0x80 // bulk IN, two packets deep
+#define FIFO_TX2_WORDS 0x10
+
+#define REQ_TYPE_MASK 0x60
+#define REQ_TYPE_STANDARD 0x00
+#define REQ_TYPE_CLASS 0x20
+#define REQ_RECIPIENT_MASK 0x1F
+#define REQ_RECIPIENT_DEVICE 0
+#define REQ_RECIPIENT_INTERFACE 1
+#define REQ_RECIPIENT_ENDPOINT 2
+
+#define REQ_GET_STATUS 0x00
+#define REQ_CLEAR_FEATURE 0x01
+#define REQ_SET_FEATURE 0x03
+#define REQ_SET_ADDRESS 0x05
+#define REQ_GET_DESCRIPTOR 0x06
+#define REQ_GET_CONFIGURATION 0x08
+#define REQ_SET_CONFIGURATION 0x09
+#define REQ_GET_INTERFACE 0x0A
+#define REQ_SET_INTERFACE 0x0B
+
+#define CDC_SET_LINE_CODING 0x20
+#define CDC_GET_LINE_CODING 0x21
+#define CDC_SET_CONTROL_LINE_STATE 0x22
+#define CDC_SEND_BREAK 0x23
+
+#define DESC_DEVICE 1
+#define DESC_CONFIG 2
+#define DESC_STRING 3
+
+#define EP0_IDLE 0
+#define EP0_DATA_IN 1
+#define EP0_DATA_OUT 2
+#define EP0_STATUS_IN 3
+#define EP0_STATUS_OUT 4
+
+static const uint8_t device_desc[18] = {
+    18, DESC_DEVICE,
+    0x00, 0x02,             // USB 2.0
+    0x02, 0x00, 0x00,       // CDC, class defined per interface
+    EP0_SIZE,
+    USB_CDC_VID & 0xFF, USB_CDC_VID >> 8,
+    USB_CDC_PID & 0xFF, USB_CDC_PID >> 8,
+    0x00, 0x02,             // device release 2.00
+    1, 2, 3,                // manufacturer, product, serial strings
+    1,                      // configurations
+};
+
+#define CONFIG_DESC_SIZE 67
+static const uint8_t config_desc[CONFIG_DESC_SIZE] = {
+    9, DESC_CONFIG, CONFIG_DESC_SIZE, 0, 2, 1, 0, 0x80, 50, // bus powered, 100 mA
+
+    // Interface 0: communications, ACM
+    9, 4, 0, 0, 1, 0x02, 0x02, 0x01, 0,
+    5, 0x24, 0x00, 0x10, 0x01, // header, CDC 1.10
+    5, 0x24, 0x01, 0x00, 1,    // call management: none, data on interface 1
+    4, 0x24, 0x02, 0x02,       // ACM: line coding and control line state
+    5, 0x24, 0x06, 0, 1,       // union: interface 0 controls interface 1
+    7, 5, CDC_CMD_EP, 0x03, CDC_CMD_SIZE, 0, 0x10,
+
+    // Interface 1: data
+    9, 4, 1, 0, 2, 0x0A, 0, 0, 0,
+    7, 5, CDC_OUT_EP, 0x02, USB_CDC_MAX_PACKET, 0, 0,
+    7, 5, CDC_IN_EP, 0x02, USB_CDC_MAX_PACKET, 0, 0,
+};
+
+static const uint8_t lang_desc[4] = {4, DESC_STRING, 0x09, 0x04}; // US English
+static const char *const strings[] = {"STMicroelectronics", "Digital Water"};
+
+// Built on request, the longest string fits
+static uint8_t string_desc[2 + 2 * 24];
+
+static uint8_t line_coding[7] = {0x00, 0xC2, 0x01, 0x00, 0, 0, 8}; // 115200 8N1
+static uint8_t ep0_buf[EP0_SIZE];
+static uint8_t rx_buf[USB_CDC_MAX_PACKET];
+
+static uint8_t ep0_state;
+static const uint8_t *ep0_data;
+static uint16_t ep0_left;
+static uint8_t ep0_zlp;
+static uint8_t ep0_request; // class request waiting for its data stage
+static uint8_t config;
+
+void usb_cdc_init(void)
+{
+  HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_FS, FIFO_RX_WORDS);
+  HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 0, FIFO_TX0_WORDS);
+  HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 1, FIFO_TX1_WORDS);
+  HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 2, FIFO_TX2_WORDS);
+  HAL_PCD_Start(&hpcd_USB_OTG_FS);
+}
+
+uint8_t usb_cdc_ep_transmit(const uint8_t *data, uint32_t len)
+{
+  return HAL_PCD_EP_Transmit(&hpcd_USB_OTG_FS, CDC_IN_EP, (uint8_t *)data, len) != HAL_OK;
+}
+
+static void string_to_desc(const char *s)
+{
+  uint8_t len = 2;
+  while (*s && len < sizeof(string_desc)) {
+    string_desc[len++] = *s++;
+    string_desc[len++] = 0;
+  }
+  string_desc[0] = len;
+  string_desc[1] = DESC_STRING;
+}
+
+// Same serial number as ST's own VCP firmware
+static void serial_to_desc(void)
+{
+  uint32_t serial0 = HAL_GetUIDw0() + HAL_GetUIDw2();
+  uint32_t serial1 = HAL_GetUIDw1();
+  uint8_t len = 2;
+
+  for (int8_t shift = 28; shift >= 0; shift -= 4) {
+    uint8_t nibble = (serial0 >> shift) & 0xF;
+    string_desc[len++] = nibble < 10 ? '0' + nibble : 'A' + nibble - 10;
+    string_desc[len++] = 0;
+  }
+  for (int8_t shift = 28; shift >= 16; shift -= 4) {
+    uint8_t nibble = (serial1 >> shift) & 0xF;
+    string_desc[len++] = nibble < 10 ? '0' + nibble : 'A' + nibble - 10;
+    string_desc[len++] = 0;
+  }
+  string_desc[0] = len;
+  string_desc[1] = DESC_STRING;
+}
+
+// EP0 only moves one packet per transfer on this core
+static void ctl_continue(PCD_HandleTypeDef *hpcd)
+{
+  uint16_t n = ep0_left < EP0_SIZE ? ep0_left : EP0_SIZE;
+  HAL_PCD_EP_Transmit(hpcd, 0x00, (uint8_t *)ep0_data, n);
+  ep0_data += n;
+  ep0_left -= n;
+}
+
+static void ctl_send(PCD_HandleTypeDef *hpcd, const uint8_t *data, uint16_t len, uint16_t w_length)
+{
+  if (len > w_length) len = w_length;
+  // Shorter than asked for and ending on a full packet: end with a ZLP
+  ep0_zlp = len < w_length && len % EP0_SIZE == 0;
+  ep0_data = data;
+  ep0_left = len;
+  ep0_state = EP0_DATA_IN;
+  ctl_continue(hpcd);
+}
+
+static void ctl_status(PCD_HandleTypeDef *hpcd)
+{
+  ep0_state = EP0_STATUS_IN;
+  HAL_PCD_EP_Transmit(hpcd, 0x00, NULL, 0);
+}
+
+static void ctl_stall(PCD_HandleTypeDef *hpcd)
+{
+  ep0_state = EP0_IDLE;
+  HAL_PCD_EP_SetStall(hpcd, 0x80);
+  HAL_PCD_EP_SetStall(hpcd, 0x00);
+}
+
+static void cdc_configure(PCD_HandleTypeDef *hpcd, uint8_t value)
+{
+  if (config) {
+    HAL_PCD_EP_Close(hpcd, CDC_IN_EP);
+    HAL_PCD_EP_Close(hpcd, CDC_OUT_EP);
+    HAL_PCD_EP_Close(hpcd, CDC_CMD_EP);
+    usb_cdc_tx_reset();
+  }
+  config = value;
+  if (config) {
+    HAL_PCD_EP_Open(hpcd, CDC_IN_EP, USB_CDC_MAX_PACKET, EP_TYPE_BULK);
+    HAL_PCD_EP_Open(hpcd, CDC_OUT_EP, USB_CDC_MAX_PACKET, EP_TYPE_BULK);
+    HAL_PCD_EP_Open(hpcd, CDC_CMD_EP, CDC_CMD_SIZE, EP_TYPE_INTR);
+    HAL_PCD_EP_Receive(hpcd, CDC_OUT_EP, rx_buf, sizeof(rx_buf));
+  }
+}
+
+static void get_descriptor(PCD_HandleTypeDef *hpcd, uint16_t w_value, uint16_t w_length)
+{
+  uint8_t index = w_value & 0xFF;
+
+  switch (w_value >> 8) {
+  case DESC_DEVICE:
+    ctl_send(hpcd, device_desc, sizeof(device_desc), w_length);
+    return;
+  case DESC_CONFIG:
+    ctl_send(hpcd, config_desc, sizeof(config_desc), w_length);
+    return;
+  case DESC_STRING:
+    if (index == 0) {
+      ctl_send(hpcd, lang_desc, sizeof(lang_desc), w_length);
+      return;
+    }
+    if (index <= 2) {
+      string_to_desc(strings[index - 1]);
+    } else if (index == 3) {
+      serial_to_desc();
+    } else {
+      break;
+    }
+    ctl_send(hpcd, string_desc, string_desc[0], w_length);
+    return;
+  }
+  ctl_stall(hpcd); // device qualifier included: full speed only
+}
+
+static void standard_request(PCD_HandleTypeDef *hpcd, const uint8_t *req, uint16_t w_value,
+                             uint16_t w_index, uint16_t w_length)
+{
+  static const uint8_t zero[2] = {0, 0};
+  uint8_t recipient = req[0] & REQ_RECIPIENT_MASK;
+
+  switch (req[1]) {
+  case REQ_GET_STATUS:
+    ctl_send(hpcd, zero, 2, w_length);
+    return;
+  case REQ_SET_ADDRESS:
+    HAL_PCD_SetAddress(hpcd, w_value & 0x7F);
+    ctl_status(hpcd);
+    return;
+  case REQ_GET_DESCRIPTOR:
+    get_descriptor(hpcd, w_value, w_length);
+    return;
+  case REQ_GET_CONFIGURATION:
+    ctl_send(hpcd, &config, 1, w_length);
+    return;
+  case REQ_SET_CONFIGURATION:
+    if (w_value > 1) break;
+    cdc_configure(hpcd, w_value);
+    ctl_status(hpcd);
+    return;
+  case REQ_GET_INTERFACE:
+    ctl_send(hpcd, zero, 1, w_length);
+    return;
+  case REQ_SET_INTERFACE:
+    if (w_value != 0) break;
+    ctl_status(hpcd);
+    return;
+  case REQ_CLEAR_FEATURE:
+  case REQ_SET_FEATURE:
+    // ENDPOINT_HALT is the only feature acted on; remote wakeup is not offered
+    if (recipient == REQ_RECIPIENT_ENDPOINT && (w_index & 0x7F)) {
+      if (req[1] == REQ_SET_FEATURE) {
+        HAL_PCD_EP_SetStall(hpcd, w_index & 0xFF);
+      } else {
+        HAL_PCD_EP_ClrStall(hpcd, w_index & 0xFF);
+      }
+    }
+    ctl_status(hpcd);
+    return;
+  }
+  ctl_stall(hpcd);
+}
+
+static void class_request(PCD_HandleTypeDef *hpcd, const uint8_t *req, uint16_t w_value,
+                          uint16_t w_length)
+{
+  switch (req[1]) {
+  case CDC_SET_LINE_CODING:
+    // Only kept to report back: the data has no baud rate
+    if (w_length != sizeof(line_coding)) break;
+    ep0_request = req[1];
+    ep0_state = EP0_DATA_OUT;
+    HAL_PCD_EP_Receive(hpcd, 0x00, ep0_buf, w_length);
+    return;
+  case CDC_GET_LINE_CODING:
+    ctl_send(hpcd, line_coding, sizeof(line_coding), w_length);
+    return;
+  case CDC_SET_CONTROL_LINE_STATE:
+    usb_cdc_tx_open(w_value & 0x01); // DTR: a terminal has the port open
+    ctl_status(hpcd);
+    return;
+  case CDC_SEND_BREAK:
+    ctl_status(hpcd);
+    return;
+  }
+  ctl_stall(hpcd);
+}
+
+void HAL_PCD_SetupStageCallback(PCD_HandleTypeDef *hpcd)
+{
+  const uint8_t *req = (const uint8_t *)hpcd->Setup;
+  uint16_t w_value = req[2] | (req[3] << 8);
+  uint16_t w_index = req[4] | (req[5] << 8);
+  uint16_t w_length = req[6] | (req[7] << 8);
+
+  ep0_request = 0;
+  switch (req[0] & REQ_TYPE_MASK) {
+  case REQ_TYPE_STANDARD:
+    standard_request(hpcd, req, w_value, w_index, w_length);
+    break;
+  case REQ_TYPE_CLASS:
+    if ((req[0] & REQ_RECIPIENT_MASK) == REQ_RECIPIENT_INTERFACE) {
+      class_request(hpcd, req, w_value, w_length);
+      break;
+    }
+    ctl_stall(hpcd);
+    break;
+  default:
+    ctl_stall(hpcd);
+    break;
+  }
+}
+
+void HAL_PCD_DataInStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+  if (epnum == (CDC_IN_EP & 0x7F)) {
+    usb_cdc_tx_done();
+    return;
+  }
+  if (epnum != 0) return;
+
+  if (ep0_state == EP0_DATA_IN) {
+    if (ep0_left) {
+      ctl_continue(hpcd);
+    } else if (ep0_zlp) {
+      ep0_zlp = 0;
+      HAL_PCD_EP_Transmit(hpcd, 0x00, NULL, 0);
+    } else {
+      ep0_state = EP0_STATUS_OUT;
+      HAL_PCD_EP_Receive(hpcd, 0x00, NULL, 0);
+    }
+  } else if (ep0_state == EP0_STATUS_IN) {
+    ep0_state = EP0_IDLE;
+  }
+}
+
+void HAL_PCD_DataOutStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
+{
+  if (epnum == CDC_OUT_EP) {
+    // Nothing reads from the host; keep the endpoint accepting
+    HAL_PCD_EP_Receive(hpcd, CDC_OUT_EP, rx_buf, sizeof(rx_buf));
+    return;
+  }
+  if (epnum != 0) return;
+
+  if (ep0_state == EP0_DATA_OUT) {
+    if (ep0_request == CDC_SET_LINE_CODING) memcpy(line_coding, ep0_buf, sizeof(line_coding));
+    ep0_request = 0;
+    ctl_status(hpcd);
+  } else if (ep0_state == EP0_STATUS_OUT) {
+    ep0_state = EP0_IDLE;
+  }
+}
+
+void HAL_PCD_ResetCallback(PCD_HandleTypeDef *hpcd)
+{
+  config = 0;
+  ep0_state = EP0_IDLE;
+  usb_cdc_tx_reset();
+  HAL_PCD_EP_Open(hpcd, 0x00, EP0_SIZE, EP_TYPE_CTRL);
+  HAL_PCD_EP_Open(hpcd, 0x80, EP0_SIZE, EP_TYPE_CTRL);
+}
+
+void HAL_PCD_DisconnectCallback(PCD_HandleTypeDef *hpcd)
+{
+  config = 0;
+  usb_cdc_tx_reset();
+}
@@ -0,0 +1,155 @@
+#include "usb_cdc_tx.h"
+#include <string.h>
+
+#ifdef USB_CDC_HOST
+#define USB_CDC_LOCK()
+#define USB_CDC_UNLOCK()
+#else
+#include "main.h"
+// Writers run in the main loop, completions in the USB interrupt
+#define USB_CDC_LOCK()                   \
+  uint32_t primask = __get_PRIMASK();    \
+  __disable_irq()
+#define USB_CDC_UNLOCK() __set_PRIMASK(primask)
+#endif
+
+#define IN_NONE 0
+#define IN_STAGE 1
+#define IN_BLOCK 2
+#define IN_ZLP 3
+
+volatile uint32_t usb_cdc_tx_dropped;
+volatile uint32_t usb_cdc_tx_bytes;
+
+static uint8_t stage[2][USB_CDC_TX_BUF_SIZE];
+static uint16_t stage_len[2];
+static uint8_t stage_fill;        // buffer taking writes
+static const uint8_t *block;      // NULL if none
+static uint32_t block_len;
+static volatile uint8_t in_flight; // IN_*
+static uint8_t in_flight_stage;    // which buffer, for IN_STAGE
+static uint8_t need_zlp;
+static volatile uint8_t port_open;
+
+// Starts the next transfer if the endpoint is free; called locked
+static void usb_cdc_kick(void)
+{
+  if (in_flight != IN_NONE) return;
+
+  if (stage_len[stage_fill]) {
+    uint8_t b = stage_fill;
+    in_flight = IN_STAGE;
+    in_flight_stage = b;
+    stage_fill = b ^ 1; // the other buffer finished before this one was filled
+    if (usb_cdc_ep_transmit(stage[b], stage_len[b])) {
+      in_flight = IN_NONE;
+      stage_fill = b;
+      return;
+    }
+    need_zlp = stage_len[b] % USB_CDC_MAX_PACKET == 0;
+    usb_cdc_tx_bytes += stage_len[b];
+  } else if (block) {
+    in_flight = IN_BLOCK;
+    if (usb_cdc_ep_transmit(block, block_len)) {
+      in_flight = IN_NONE;
+      return;
+    }
+    need_zlp = block_len % USB_CDC_MAX_PACKET == 0;
+    usb_cdc_tx_bytes += block_len;
+  } else if (need_zlp) {
+    in_flight = IN_ZLP;
+    if (usb_cdc_ep_transmit(NULL, 0)) {
+      in_flight = IN_NONE;
+      return;
+    }
+    need_zlp = 0;
+  }
+}
+
+void usb_cdc_tx_done(void)
+{
+  USB_CDC_LOCK();
+  if (in_flight == IN_STAGE) {
+    stage_len[in_flight_stage] = 0;
+  } else if (in_flight == IN_BLOCK) {
+    block = NULL;
+  }
+  in_flight = IN_NONE;
+  if (port_open) usb_cdc_kick();
+  USB_CDC_UNLOCK();
+}
+
+void usb_cdc_tx_open(uint8_t open)
+{
+  USB_CDC_LOCK();
+  port_open = open;
+  if (open) {
+    usb_cdc_kick(); // a ZLP may be owed from before the close
+  } else {
+    // Keep what the endpoint is still sending, drop the rest
+    if (in_flight == IN_STAGE) {
+      stage_len[stage_fill] = 0;
+    } else {
+      stage_len[0] = stage_len[1] = 0;
+    }
+    if (in_flight != IN_BLOCK) block = NULL;
+  }
+  USB_CDC_UNLOCK();
+}
+
+void usb_cdc_tx_reset(void)
+{
+  USB_CDC_LOCK();
+  port_open = 0;
+  stage_len[0] = stage_len[1] = 0;
+  stage_fill = 0;
+  block = NULL;
+  in_flight = IN_NONE;
+  need_zlp = 0;
+  USB_CDC_UNLOCK();
+}
+
+uint8_t usb_cdc_is_open(void)
+{
+  return port_open;
+}
+
+uint8_t usb_cdc_write(const void *data, uint16_t len)
+{
+  uint8_t queued = 0;
+
+  USB_CDC_LOCK();
+  if (port_open) {
+    uint16_t fill = stage_len[stage_fill];
+    if (fill + len <= USB_CDC_TX_BUF_SIZE) {
+      memcpy(&stage[stage_fill][fill], data, len);
+      stage_len[stage_fill] = fill + len;
+      usb_cdc_kick();
+      queued = 1;
+    } else {
+      usb_cdc_tx_dropped++;
+    }
+  }
+  USB_CDC_UNLOCK();
+  return queued;
+}
+
+uint8_t usb_cdc_send_block(const uint8_t *data, uint32_t len)
+{
+  uint8_t queued = 0;
+
+  USB_CDC_LOCK();
+  if (port_open && !block && len) {
+    block = data;
+    block_len = len;
+    usb_cdc_kick();
+    queued = 1;
+  }
+  USB_CDC_UNLOCK();
+  return queued;
+}
+
+uint8_t usb_cdc_block_busy(void)
+{
+  return block != NULL;
+}
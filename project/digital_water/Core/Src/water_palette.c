@@ -0,0 +1,14 @@
+// Generated by tools/gen_water_palette.py - do not edit.
+
+#include "water_palette.h"
+
+const uint16_t sim_palette[SIM_PALETTE_COLORS] = {
+    0x0000, 0x0090, 0x0010, 0x00FF, 0x2FE5, 0xCAC3, 0x259A, 0x4068,
+    0x2FE5, 0xCAC3, 0xE8AA, 0x4792, 0x71E5, 0x10DD, 0xD0CC, 0x6FC4,
+    0xD8F6, 0xB7F6, 0x97EE, 0x77EE,
+};
+
+const uint16_t splat_tone[SIM_SPLAT_TONE_LEVELS] = {
+    0x0000, 0x0000, 0x0018, 0x0020, 0x0028, 0x0038, 0x0040, 0x0048,
+    0x0050, 0x0058, 0x0060, 0x0068, 0x0078, 0x0080, 0x0088, 0x0090,
+};
@@ -23,22 +23,30 @@
 ;
 ; Amount of memory (in bytes) allocated for Stack
 ; Tailor this value to your application needs
+; Budget (estimated, check against stack_high_water() in the button dump):
+; four preemption levels (NVIC_PRIORITYGROUP_2, stm32f4xx_hal_msp.c) can nest
+; on top of the main loop, each stacking a 104-byte FPU frame (~430 B), plus
+; the handlers' own frames: USB at level 3, a whole band render in the SPI1
+; DMA completion at level 2, the accelerometer DMA/EXTI at 1, TIM6/TIM7 at 0
+; (~450 B). The deepest main loop path, the button dumps into snprintf and
+; telem_send, is ~500 B with its packet buffers static. ~1.4 KB in all.
 ; <h> Stack Configuration
 ;   <o> Stack Size (in Bytes) <0x0-0xFFFFFFFF:8>
 ; </h>
 
-Stack_Size		EQU     0x400
+Stack_Size		EQU     0x800
 
                 AREA    STACK, NOINIT, READWRITE, ALIGN=3
 Stack_Mem       SPACE   Stack_Size
 __initial_sp
 
 
+; Nothing calls malloc; the RAM goes to the stack instead
 ; <h> Heap Configuration
 ;   <o>  Heap Size (in Bytes) <0x0-0xFFFFFFFF:8>
 ; </h>
 
-Heap_Size      EQU     0x200
+Heap_Size      EQU     0x0
 
                 AREA    HEAP, NOINIT, READWRITE, ALIGN=3
 __heap_base
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""Decode the deferred log stream from USART3.
+
+The firmware sends format IDs and raw arguments (see Core/Inc/dlog.h); the
+format strings are read from Core/Inc/dlog_formats.h, so run this against the
+same tree the firmware was built from.
+
+    python tools/dlog_decode.py COM5            # live, needs pyserial
+    python tools/dlog_decode.py capture.bin     # a raw capture
+
+Bytes outside records (testPrint frames, anything sent before the logger)
+are passed through as text; telemetry packets are dropped.
+"""
+
+import os
+import re
+import struct
+import sys
+
+from telem_decode import packet_at
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+FORMATS = os.path.join(HERE, "..", "Core", "Inc", "dlog_formats.h")
+
+DLOG_SYNC = 0xD1
+DLOG_ID_TEXT = 0xFF
+DLOG_ID_DROPPED = 0xFE
+DLOG_MAX_ARGS = 8
+BAUD = 115200
+
+SPEC = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?(?:hh|h|ll|l)?([diuxXcf%])")
+
+
+def load_formats(path=FORMATS):
+    formats = []
+    with open(path) as f:
+        for line in f:
+            m = re.match(r'\s*DLOG_FORMAT\(\s*(\w+)\s*,\s*"(.*)"\s*\)', line)
+            if m:
+                text = m.group(2).encode().decode("unicode_escape")
+                formats.append((m.group(1), text))
+    return formats
+
+
+def format_record(fmt, words):
+    """Applies a C format string to 32-bit words, one per conversion."""
+    out = []
+    pos = 0
+    args = iter(words)
+    for m in SPEC.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        conv = m.group(1)
+        spec = re.sub(r"(hh|h|ll|l)", "", m.group(0))
+        if conv == "%":
+            out.append("%")
+            continue
+        word = next(args, 0)
+        if conv == "f":
+            out.append(spec % struct.unpack("<f", struct.pack("<I", word))[0])
+        elif conv in "di":
+            out.append(spec % struct.unpack("<i", struct.pack("<I", word))[0])
+        elif conv == "c":
+            out.append(chr(word & 0xFF))
+        else:
+            out.append(spec % word)
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+class Decoder:
+    def __init__(self, formats):
+        self.formats = formats
+        self.buf = bytearray()
+
+    def feed(self, data):
+        """Consumes bytes, returns the decoded text so far."""
+        self.buf += data
+        out = []
+        while self.buf:
+            packet = packet_at(self.buf)
+            if packet == "short":
+                break
+            if packet:
+                del self.buf[:packet[2]]  # telemetry, see telem_decode.py
+                continue
+            if self.buf[0] != DLOG_SYNC:
+                out.append(chr(self.buf.pop(0)))
+                continue
+            if len(self.buf) < 3:
+                break
+            ident, count = self.buf[1], self.buf[2]
+            if ident == DLOG_ID_TEXT:
+                size = 3 + count
+            elif ident == DLOG_ID_DROPPED or (ident < len(self.formats) and count <= DLOG_MAX_ARGS):
+                size = 3 + 4 * count
+            else:
+                out.append(chr(self.buf.pop(0)))  # not a record, resync
+                continue
+            if len(self.buf) < size:
+                break
+            body = bytes(self.buf[3:size])
+            del self.buf[:size]
+
+            if ident == DLOG_ID_TEXT:
+                out.append(body.decode("latin-1"))
+            else:
+                words = struct.unpack("<%dI" % count, body)
+                if ident == DLOG_ID_DROPPED:
+                    out.append("[dlog: %d records dropped]\n" % words[0])
+                else:
+                    out.append(format_record(self.formats[ident][1], words))
+        return "".join(out)
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__)
+        return 1
+    decoder = Decoder(load_formats())
+    source = sys.argv[1]
+
+    if os.path.exists(source):
+        with open(source, "rb") as f:
+            sys.stdout.write(decoder.feed(f.read()))
+        return 0
+
+    import serial  # pyserial, only for live capture
+    with serial.Serial(source, BAUD, timeout=0.1) as port:
+        while True:
+            sys.stdout.write(decoder.feed(port.read(4096)))
+            sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    sys.exit(main())
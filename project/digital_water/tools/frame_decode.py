@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""Rebuild mirrored frames from USART3 and write them as PPM images.
+
+Frame layout (streamFrame() in Core/Src/fluid_sim.c):
+
+    keyframe: PREAMBLE\\0, 96 * 64 palette indices, SUFFIX\\0
+    delta:    DELTA_PREAMBLE\\0, payload length (u16 LE), payload, SUFFIX\\0
+
+A delta payload is the XOR against the previous frame, PackBits encoded one
+row at a time. Deltas before the first keyframe are dropped. Everything
+outside a frame (log records, telemetry) is skipped.
+
+    python tools/frame_decode.py COM5 frames/          # live, needs pyserial
+    python tools/frame_decode.py capture.bin frames/
+"""
+
+import os
+import struct
+import sys
+
+from gen_water_palette import BASE_PALETTE, DENSITY_LEVELS, SPEED_LEVELS, shade, to_panel
+
+PREAMBLE = b"\r\n!START!\r\n\0"
+DELTA_PREAMBLE = b"\r\n!DELTA!\r\n\0"
+SUFFIX = b"!END!\r\n\0"
+WIDTH = 96
+HEIGHT = 64
+BAUD = 115200
+
+
+def panel_to_rgb(value):
+    word = ((value >> 8) | (value << 8)) & 0xFFFF
+    r, g, b = word & 0x1F, (word >> 5) & 0x3F, word >> 11
+    return bytes((r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2))
+
+
+PALETTE = [panel_to_rgb(value) for _, value in BASE_PALETTE] + [
+    panel_to_rgb(to_panel(shade(s, d)))
+    for s in range(SPEED_LEVELS) for d in range(DENSITY_LEVELS)]
+
+
+def unpack_bits(data, size):
+    out = bytearray()
+    pos = 0
+    while len(out) < size and pos < len(data):
+        n = data[pos]
+        pos += 1
+        if n < 128:
+            out += data[pos:pos + n + 1]
+            pos += n + 1
+        elif n > 128:
+            out += data[pos:pos + 1] * (257 - n)
+            pos += 1
+    return out, pos
+
+
+def undelta(payload):
+    """Returns the frame-sized XOR mask, or None if the payload is malformed."""
+    mask = bytearray()
+    pos = 0
+    for _ in range(HEIGHT):
+        row, used = unpack_bits(payload[pos:], WIDTH)
+        if len(row) != WIDTH:
+            return None
+        mask += row
+        pos += used
+    return mask if pos == len(payload) else None
+
+
+class Decoder:
+    def __init__(self, outdir):
+        self.buf = bytearray()
+        self.outdir = outdir
+        self.frame = None
+        self.count = 0
+        self.wire_bytes = 0
+
+    def write(self, wire):
+        pixels = b"".join(PALETTE[i] if i < len(PALETTE) else b"\xff\x00\xff"
+                          for i in self.frame)
+        path = os.path.join(self.outdir, "frame_%05d.ppm" % self.count)
+        with open(path, "wb") as f:
+            f.write(b"P6 %d %d 255\n" % (WIDTH, HEIGHT) + pixels)
+        self.count += 1
+        self.wire_bytes += wire
+
+    def frame_at(self, pos):
+        """Returns bytes used by a frame at pos, 0 if there is none, or None
+        if one may start there but is incomplete."""
+        buf = self.buf
+        if buf.startswith(PREAMBLE, pos):
+            end = pos + len(PREAMBLE) + WIDTH * HEIGHT
+            if len(buf) < end + len(SUFFIX):
+                return None
+            if buf[end:end + len(SUFFIX)] != SUFFIX:
+                return 0
+            self.frame = bytearray(buf[pos + len(PREAMBLE):end])
+            self.write(end + len(SUFFIX) - pos)
+            return end + len(SUFFIX) - pos
+
+        if buf.startswith(DELTA_PREAMBLE, pos):
+            start = pos + len(DELTA_PREAMBLE) + 2
+            if len(buf) < start:
+                return None
+            length = struct.unpack_from("<H", buf, start - 2)[0]
+            end = start + length
+            if len(buf) < end + len(SUFFIX):
+                return None
+            if buf[end:end + len(SUFFIX)] != SUFFIX:
+                return 0
+            mask = undelta(buf[start:end])
+            if mask is None:
+                return 0
+            if self.frame is not None:
+                self.frame = bytearray(a ^ b for a, b in zip(self.frame, mask))
+                self.write(end + len(SUFFIX) - pos)
+            return end + len(SUFFIX) - pos
+
+        # Either marker may be cut off at the end of the buffer
+        tail = buf[pos:]
+        if len(tail) < len(PREAMBLE) and (PREAMBLE.startswith(tail) or
+                                          DELTA_PREAMBLE.startswith(tail)):
+            return None
+        return 0
+
+    def feed(self, data):
+        self.buf += data
+        pos = 0
+        while pos < len(self.buf):
+            used = self.frame_at(pos)
+            if used is None:
+                break
+            pos += used or 1
+        del self.buf[:pos]
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__)
+        return 1
+    source, outdir = sys.argv[1:]
+    os.makedirs(outdir, exist_ok=True)
+    decoder = Decoder(outdir)
+
+    if os.path.exists(source):
+        with open(source, "rb") as f:
+            decoder.feed(f.read())
+    else:
+        import serial  # pyserial, only for live capture
+        try:
+            with serial.Serial(source, BAUD, timeout=0.1) as port:
+                while True:
+                    decoder.feed(port.read(4096))
+        except KeyboardInterrupt:
+            pass
+
+    if decoder.count:
+        raw = len(PREAMBLE) + WIDTH * HEIGHT + len(SUFFIX)
+        mean = decoder.wire_bytes / decoder.count
+        print("%d frames, %.0f bytes per frame on the wire (%.1fx smaller than raw)"
+              % (decoder.count, mean, raw / mean), file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Generate the render palette and colour lookup tables.
+
+Writes Core/Inc/water_palette.h and Core/Src/water_palette.c. Keil runs this
+before every build (Options for Target -> User -> Before Build), and the
+output is committed so the firmware still builds without Python.
+
+Edit the colours and quantisation steps below, not the generated files.
+
+Colours are given as 8-bit (R, G, B) and converted to the panel's pixel
+format: CMD_SET_REMAP 0x76 selects 65k colour in BGR order, and the frame is
+streamed little-endian from uint16_t buffers, so each value is stored as a
+byte-swapped BGR565 word.
+"""
+
+import os
+
+# Base palette, in index order. Raw panel values keep the colours the
+# renderer used before the palette was generated.
+BASE_PALETTE = [
+    ("BACKGROUND", 0x0000),
+    ("WATER", 0x0090),
+    ("SOLID", 0x0010),
+    ("AIR", 0x00FF),
+]
+
+# Water shading, indexed by quantised mean cell speed and particle count
+SPEED_LEVELS = 4
+DENSITY_LEVELS = 4
+SPEED_STEP = 2.0  # cells per second per speed level
+DENSITY_STEP = 4  # particles per density level
+
+SHALLOW = (30, 90, 200)
+DEEP = (0, 10, 110)
+FOAM = (220, 240, 255)
+FOAM_MAX = 0.85     # strongest foam blend, at top speed
+SPARSE_FOAM = 0.5   # foam blend for the sparsest cells at rest
+
+# Splat coverage -> colour, from background to water
+SPLAT_TONE_LEVELS = 16
+SPLAT_THRESHOLD = 2  # levels below this stay background
+SPLAT_BACKGROUND = (0, 0, 0)
+SPLAT_WATER = (0, 0, 148)
+
+
+def to_panel(rgb):
+    r, g, b = (max(0, min(255, int(round(c)))) for c in rgb)
+    word = ((b >> 3) << 11) | ((g >> 2) << 5) | (r >> 3)
+    return ((word >> 8) | (word << 8)) & 0xFFFF
+
+
+def lerp(a, b, t):
+    return tuple(x + (y - x) * t for x, y in zip(a, b))
+
+
+def shade(speed, density):
+    depth = density / (DENSITY_LEVELS - 1)
+    body = lerp(SHALLOW, DEEP, depth)
+    foam = max(speed / (SPEED_LEVELS - 1), (1 - depth) * SPARSE_FOAM / FOAM_MAX)
+    return lerp(body, FOAM, min(1.0, foam) * FOAM_MAX)
+
+
+def splat_tone(level):
+    if level < SPLAT_THRESHOLD:
+        return SPLAT_BACKGROUND
+    return lerp(SPLAT_BACKGROUND, SPLAT_WATER, (level + 1) / SPLAT_TONE_LEVELS)
+
+
+def table(values, per_line=8):
+    rows = []
+    for i in range(0, len(values), per_line):
+        rows.append("    " + " ".join("0x%04X," % v for v in values[i:i + per_line]))
+    return "\n".join(rows)
+
+
+def main():
+    root = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Core")
+    banner = "// Generated by tools/gen_water_palette.py - do not edit.\n"
+
+    shades = [to_panel(shade(s, d))
+              for s in range(SPEED_LEVELS) for d in range(DENSITY_LEVELS)]
+    palette = [value for _, value in BASE_PALETTE] + shades
+    tones = [to_panel(splat_tone(level)) for level in range(SPLAT_TONE_LEVELS)]
+
+    header = [banner, "#ifndef __WATER_PALETTE_H", "#define __WATER_PALETTE_H", "",
+              "#include <stdint.h>", "",
+              "// Base palette indices"]
+    for index, (name, _) in enumerate(BASE_PALETTE):
+        header.append("#define SIM_PAL_%s %d" % (name, index))
+    header += [
+        "",
+        "// Shaded water: SIM_PAL_SHADE_BASE + SIM_SHADE_INDEX(speed, density)",
+        "#define SIM_PAL_SHADE_BASE %d" % len(BASE_PALETTE),
+        "#define SIM_SHADE_SPEED_LEVELS %d" % SPEED_LEVELS,
+        "#define SIM_SHADE_DENSITY_LEVELS %d" % DENSITY_LEVELS,
+        "#define SIM_SHADE_SPEED_STEP ((float)%r)" % SPEED_STEP,
+        "#define SIM_SHADE_DENSITY_STEP %d" % DENSITY_STEP,
+        "#define SIM_SHADE_INDEX(speed, density) \\",
+        "  ((speed) * SIM_SHADE_DENSITY_LEVELS + (density))",
+        "",
+        "#define SIM_PALETTE_COLORS %d" % len(palette),
+        "#define SIM_SPLAT_TONE_LEVELS %d" % SPLAT_TONE_LEVELS,
+        "",
+        "extern const uint16_t sim_palette[SIM_PALETTE_COLORS];",
+        "extern const uint16_t splat_tone[SIM_SPLAT_TONE_LEVELS];",
+        "",
+        "#endif",
+        "",
+    ]
+
+    source = [banner, '#include "water_palette.h"', "",
+              "const uint16_t sim_palette[SIM_PALETTE_COLORS] = {",
+              table(palette), "};", "",
+              "const uint16_t splat_tone[SIM_SPLAT_TONE_LEVELS] = {",
+              table(tones), "};", ""]
+
+    with open(os.path.join(root, "Inc", "water_palette.h"), "w", newline="\n") as f:
+        f.write("\n".join(header))
+    with open(os.path.join(root, "Src", "water_palette.c"), "w", newline="\n") as f:
+        f.write("\n".join(source))
+
+
+if __name__ == "__main__":
+    main()
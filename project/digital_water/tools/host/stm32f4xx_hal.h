@@ -0,0 +1,37 @@
+/* Stand-in for the HAL header, for building simulation modules on the host.
+
+   Put tools/host ahead of the firmware include paths (-Itools/host -ICore/Inc):
+   Core/Inc/main.h then picks this up instead of the HAL. Only the types and
+   calls the host-built modules name are here; the tool linking them
+   provides the calls.
+*/
+#ifndef __STM32F4xx_HAL_H
+#define __STM32F4xx_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+  HAL_OK = 0x00U,
+  HAL_ERROR = 0x01U,
+  HAL_BUSY = 0x02U,
+  HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+  HAL_UART_STATE_RESET = 0x00U,
+  HAL_UART_STATE_READY = 0x20U,
+  HAL_UART_STATE_BUSY = 0x24U
+} HAL_UART_StateTypeDef;
+
+typedef struct
+{
+  int unused;
+} UART_HandleTypeDef;
+
+HAL_UART_StateTypeDef HAL_UART_GetState(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size);
+
+#endif
@@ -0,0 +1,246 @@
+/* Motion-to-photon latency of the frame loop on a simulated clock.
+
+   Build and run on the host from the project directory:
+
+     cc -O2 -DM2P_HOST -DPROF_HOST -ICore/Inc -o m2p_sim tools/m2p_sim.c Core/Src/m2p.c
+     ./m2p_sim [name=value ...]
+
+   The loop of main.c is replayed against a simulated 168 MHz cycle counter,
+   feeding the same m2p_* calls the firmware makes, so the table at the end is
+   the one m2p_dump() prints on the board. Modelled:
+
+     - the ADXL362 measuring at odr_hz into its FIFO, INT1 raised every
+       watermark sets (1 for DATA_READY), and the SPI3 read landing read_us
+       later, each set stamped with m2p_sample_stamp() as accelerometer.c does
+     - frames released at render_fps, physics ticks at physics_fps with at
+       most 2 catch-up steps a frame, as sim_tick_take()
+     - step_ms per Sim_Physics_Step(), render_ms for renderImage(), then the
+       frame on SPI1 for display_ms, oled_drawframe() waiting for the previous
+       one first and returning after draw_ms; every cost varies by +-jitter %
+
+   The tasks (sched.h) are replayed in the order the single loop ran them:
+   samples and due steps are taken at the start of each frame, where the
+   firmware runs them on their own releases, so the gravity and step hops
+   come out pessimistic. The governor is not modelled: every frame is drawn.
+   Costs default to rough figures; use the ones prof_dump() reports for the
+   build being judged.
+
+     ./m2p_sim watermark=1              # DATA_READY instead of the FIFO
+     ./m2p_sim physics_fps=30 step_ms=6
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "m2p.h"
+
+#define US ((uint64_t)M2P_HOST_HZ / 1000000)
+#define MS (1000 * US)
+#define RING 64
+#define MAX_CATCHUP 2
+
+static struct
+{
+	const char *name;
+	double value;
+} params[] = {
+	{"seconds", 60},
+	{"odr_hz", 100},
+	{"watermark", 5},
+	{"read_us", 150},
+	{"render_fps", 30},
+	{"physics_fps", 15},
+	{"step_ms", 12},
+	{"render_ms", 4},
+	{"display_ms", 3},
+	{"draw_ms", 0.5},
+	{"orient_us", 15},
+	{"jitter", 10},
+	{"seed", 1},
+};
+
+enum { SECONDS, ODR_HZ, WATERMARK, READ_US, RENDER_FPS, PHYSICS_FPS, STEP_MS, RENDER_MS, DISPLAY_MS,
+	DRAW_MS, ORIENT_US, JITTER, SEED };
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+// A cost in cycles, varied by the jitter percentage
+static uint64_t cost(double base)
+{
+	double spread = params[JITTER].value / 100.0;
+	double scale = 1.0 + spread * ((double)rnd(2001) / 1000.0 - 1.0);
+	return (uint64_t)(base * scale);
+}
+
+static uint64_t now;
+
+// Sensor side
+static uint64_t sample_period;
+static uint64_t next_sample; // when the next set is measured
+static uint32_t fifo_sets;   // measured, not read yet
+static uint64_t read_done;   // when the read in flight lands, 0 if none
+static uint32_t read_sets;
+
+// Sample ring, as accel_ring_push() / accel_ring_pop()
+static struct
+{
+	uint32_t stamp;
+	uint64_t ready;
+} ring[RING];
+static uint32_t ring_head, ring_tail, ring_dropped;
+
+// Display side
+static uint64_t frame_done; // when the frame on SPI1 finishes, 0 if idle
+
+static void clock_at(uint64_t t)
+{
+	m2p_host_cycles = (uint32_t)t;
+}
+
+// Runs the interrupt side of everything due up to t, in time order
+static void advance(uint64_t t)
+{
+	for (;;) {
+		uint64_t next = next_sample;
+		if (read_done && read_done < next) next = read_done;
+		if (frame_done && frame_done < next) next = frame_done;
+		if (next > t) break;
+
+		clock_at(next);
+		if (next == frame_done) {
+			m2p_photon();
+			frame_done = 0;
+		} else if (next == read_done) {
+			// DMA completion: the sets read are stamped newest last
+			for (uint32_t i = 0; i < read_sets; i++) {
+				if (ring_head - ring_tail == RING) {
+					ring_dropped++;
+					continue;
+				}
+				ring[ring_head % RING].stamp = m2p_sample_stamp(i, read_sets, (uint32_t)params[ODR_HZ].value);
+				ring[ring_head % RING].ready = next;
+				ring_head++;
+			}
+			read_done = 0;
+			// INT1 still high if the watermark refilled meanwhile
+			if (fifo_sets >= params[WATERMARK].value) {
+				read_sets = fifo_sets;
+				fifo_sets = 0;
+				read_done = next + cost(params[READ_US].value * US);
+			}
+		} else {
+			fifo_sets++;
+			next_sample += sample_period;
+			if (!read_done && fifo_sets >= params[WATERMARK].value) {
+				read_sets = fifo_sets;
+				fifo_sets = 0;
+				read_done = next + cost(params[READ_US].value * US);
+			}
+		}
+	}
+	now = t;
+	clock_at(now);
+}
+
+static int parse(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++) {
+		const char *eq = strchr(argv[i], '=');
+		size_t n;
+		for (n = 0; n < sizeof(params) / sizeof(params[0]); n++) {
+			if (eq && strlen(params[n].name) == (size_t)(eq - argv[i]) &&
+			    strncmp(params[n].name, argv[i], eq - argv[i]) == 0)
+				break;
+		}
+		if (n == sizeof(params) / sizeof(params[0])) {
+			fprintf(stderr, "unknown parameter %s\n", argv[i]);
+			return 0;
+		}
+		params[n].value = atof(eq + 1);
+	}
+	if (params[WATERMARK].value < 1 || params[ODR_HZ].value <= 0 || params[RENDER_FPS].value <= 0 ||
+	    params[PHYSICS_FPS].value <= 0) {
+		fprintf(stderr, "bad parameters\n");
+		return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	if (!parse(argc, argv)) {
+		fprintf(stderr, "parameters:");
+		for (size_t n = 0; n < sizeof(params) / sizeof(params[0]); n++)
+			fprintf(stderr, " %s=%g", params[n].name, params[n].value);
+		fprintf(stderr, "\n");
+		return 1;
+	}
+	seed = (uint32_t)params[SEED].value;
+
+	uint64_t end = (uint64_t)(params[SECONDS].value * 1000) * MS;
+	uint64_t frame_period = (uint64_t)(M2P_HOST_HZ / params[RENDER_FPS].value);
+	uint64_t tick_period = (uint64_t)(M2P_HOST_HZ / params[PHYSICS_FPS].value);
+	uint64_t next_frame = 0;
+	uint64_t ticks_taken = 0;
+	uint32_t frames = 0, steps_run = 0, dropped = 0;
+
+	sample_period = (uint64_t)(M2P_HOST_HZ / params[ODR_HZ].value);
+	next_sample = rnd((uint32_t)sample_period); // sensor phase against the loop
+	m2p_init();
+
+	while (now < end) {
+		// Render task release
+		if (now < next_frame) advance(next_frame);
+		next_frame += frame_period;
+		if (now >= next_frame) next_frame = now + frame_period;
+
+		// Drain the ring through the orientation filter
+		uint32_t samples = 0, newest = 0;
+		while (ring_tail != ring_head && ring[ring_tail % RING].ready <= now) {
+			newest = ring[ring_tail % RING].stamp;
+			ring_tail++;
+			samples++;
+			advance(now + cost(params[ORIENT_US].value * US));
+		}
+		if (samples) m2p_gravity(newest);
+
+		// sim_tick_take()
+		uint64_t ticks = now / tick_period;
+		uint64_t due = ticks - ticks_taken;
+		ticks_taken = ticks;
+		if (due > MAX_CATCHUP) {
+			dropped += due - MAX_CATCHUP;
+			due = MAX_CATCHUP;
+		}
+		for (uint64_t i = 0; i < due; i++) {
+			advance(now + cost(params[STEP_MS].value * MS));
+			m2p_stepped();
+			steps_run++;
+		}
+
+		advance(now + cost(params[RENDER_MS].value * MS));
+		m2p_rendered();
+		m2p_display_start();
+		// oled_drawframe() waits for the previous frame, then queues this one
+		if (frame_done) advance(frame_done);
+		frame_done = now + cost(params[DISPLAY_MS].value * MS);
+		advance(now + cost(params[DRAW_MS].value * MS));
+
+		m2p_collect();
+		frames++;
+	}
+	if (frame_done) advance(frame_done);
+	m2p_collect();
+
+	printf("%.0f s: %u frames, %u steps, %u ticks dropped, %u samples dropped\n", params[SECONDS].value,
+	       (unsigned)frames, (unsigned)steps_run, (unsigned)dropped, (unsigned)ring_dropped);
+	m2p_dump();
+	return 0;
+}
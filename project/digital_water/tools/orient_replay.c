@@ -0,0 +1,67 @@
+/* Replay recorded accelerometer samples through the orientation module.
+
+   Build and run on the host from the project directory:
+
+     cc -O2 -DORIENT_HOST -ICore/Inc -o orient_replay tools/orient_replay.c Core/Src/orientation.c -lm
+     ./orient_replay trace.csv > gravity.csv
+
+   The input holds one raw ADXL362 sample per line as "x,y,z" in counts (the
+   values accel_ring_pop() hands the main loop); lines that do not parse, like
+   a header, are skipped. Every FRAME_SAMPLES samples the gravity direction is
+   taken, as the main loop does once per frame, and printed next to the old
+   roll/pitch result computed in double precision on the unfiltered sample.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "orientation.h"
+
+int main(int argc, char **argv)
+{
+	FILE *in = stdin;
+	int frame_samples = 4; // 100 Hz samples over a ~25 fps frame
+
+	if (argc > 1 && (in = fopen(argv[1], "r")) == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	if (argc > 2) frame_samples = atoi(argv[2]);
+	if (frame_samples < 1) frame_samples = 1;
+
+	orient_reset();
+	printf("sample,x,y,z,filt_x,filt_y,filt_z,grav_x,grav_y,legacy_x,legacy_y\n");
+
+	char line[128];
+	long n = 0;
+	float gx = 0.0f, gy = 1.0f;
+	while (fgets(line, sizeof(line), in)) {
+		int x, y, z;
+		if (sscanf(line, "%d,%d,%d", &x, &y, &z) != 3) continue;
+
+		orient_update((int16_t)x, (int16_t)y, (int16_t)z);
+		if (++n % frame_samples) continue;
+
+		orient_gravity(&gx, &gy);
+
+		// main.c before the orientation module
+		double x_g = x / 1024.0, y_g = y / 1024.0, z_g = z / 1024.0;
+		double roll = atan(y_g / sqrt(pow(x_g, 2) + pow(z_g, 2)));
+		double pitch = atan(x_g / sqrt(pow(y_g, 2) + pow(z_g, 2)));
+		double lx = -sin(roll), ly = sin(pitch);
+		double mag = sqrt(lx * lx + ly * ly);
+		if (mag != 0) {
+			lx /= mag;
+			ly /= mag;
+		}
+
+		int16_t filt[3];
+		orient_filtered(filt);
+		printf("%ld,%d,%d,%d,%d,%d,%d,%.4f,%.4f,%.4f,%.4f\n", n, x, y, z,
+			   filt[0], filt[1], filt[2], gx, gy, lx, ly);
+	}
+
+	if (in != stdin) fclose(in);
+	return 0;
+}
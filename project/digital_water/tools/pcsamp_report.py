@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""Attribute a PC sampler dump to functions.
+
+pcsamp_dump() (Core/Inc/pcsamp.h) sends a TELEM_TYPE_PCSAMP_INFO packet and
+then the non-empty histogram buckets as TELEM_TYPE_PCSAMP_BUCKETS packets.
+Each bucket's count is shared between the functions it overlaps by bytes,
+using the symbol table of the linker map, so HAL and C library code shows up
+as well as our own. The map must come from the same build as the firmware.
+
+    python tools/pcsamp_report.py capture.bin [digital_water.map] [--top N]
+    python tools/pcsamp_report.py COM5                  # live, needs pyserial
+
+The most recent dump in the capture is used.
+"""
+
+import argparse
+import bisect
+import os
+import re
+import struct
+import sys
+from collections import defaultdict
+
+from telem_decode import BAUD, packet_at
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+MAP = os.path.join(HERE, "..", "MDK-ARM", "digital_water", "digital_water.map")
+
+TELEM_TYPE_PCSAMP_INFO = 0x02
+TELEM_TYPE_PCSAMP_BUCKETS = 0x03
+INFO_FORMAT = "<IIIIHBB"  # Pcsamp_Info_t
+PAIR_FORMAT = "<HH"        # Pcsamp_Pair_t
+
+# "    name    0x08003895   Thumb Code    30  object.o(section)"
+SYMBOL = re.compile(r"^\s+(\S+)\s+0x([0-9a-fA-F]{8})\s+(?:Thumb|ARM) Code\s+(\d+)\s+(\S+?)\(")
+
+
+def load_functions(path):
+    """Returns sorted (start, end, name, object) for every code symbol."""
+    functions = {}
+    with open(path, errors="replace") as f:
+        for line in f:
+            m = SYMBOL.match(line)
+            if not m:
+                continue
+            start = int(m.group(2), 16) & ~1  # Thumb bit
+            size = int(m.group(3))
+            if size == 0:
+                continue
+            functions[start] = (start, start + size, m.group(1), m.group(4))
+    return sorted(functions.values())
+
+
+class Dump:
+    def __init__(self):
+        self.info = None
+        self.buckets = {}
+
+    def packet(self, kind, payload):
+        if kind == TELEM_TYPE_PCSAMP_INFO and len(payload) == struct.calcsize(INFO_FORMAT):
+            # A new dump starts: forget the previous one
+            self.info = dict(zip(
+                ["base", "samples", "outside", "in_handler", "rate_hz", "bucket_bits",
+                 "stopped_full"], struct.unpack(INFO_FORMAT, payload)))
+            self.buckets = {}
+        elif kind == TELEM_TYPE_PCSAMP_BUCKETS and self.info is not None:
+            for bucket, count in struct.iter_unpack(PAIR_FORMAT, payload):
+                self.buckets[bucket] = count
+
+
+def read_dump(source):
+    dump = Dump()
+    buf = bytearray()
+
+    def feed(data):
+        buf.extend(data)
+        pos = 0
+        while pos < len(buf):
+            found = packet_at(buf, pos)
+            if found == "short":
+                break
+            if found is None:
+                pos += 1
+                continue
+            kind, payload, size = found
+            dump.packet(kind, payload)
+            pos += size
+        del buf[:pos]
+
+    if os.path.exists(source):
+        with open(source, "rb") as f:
+            feed(f.read())
+        return dump
+
+    import serial  # pyserial, only for live capture
+    print("waiting for a dump (press the button)...", file=sys.stderr)
+    with serial.Serial(source, BAUD, timeout=2) as port:
+        while True:
+            data = port.read(4096)
+            feed(data)
+            # Buckets stop arriving once the dump is over
+            if not data and dump.buckets:
+                return dump
+
+
+def attribute(dump, functions):
+    """Shares each bucket's count between the functions it overlaps."""
+    size = 1 << dump.info["bucket_bits"]
+    starts = [f[0] for f in functions]
+    by_function = defaultdict(float)
+    unknown = 0.0
+
+    for bucket, count in dump.buckets.items():
+        lo = dump.info["base"] + bucket * size
+        hi = lo + size
+        covered = 0
+        i = max(bisect.bisect_right(starts, lo) - 1, 0)
+        while i < len(functions) and functions[i][0] < hi:
+            start, end, name, obj = functions[i]
+            overlap = min(end, hi) - max(start, lo)
+            if overlap > 0:
+                by_function[(name, obj)] += count * overlap / size
+                covered += overlap
+            i += 1
+        unknown += count * (size - covered) / size
+    return by_function, unknown
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("source", help="capture file or serial port")
+    parser.add_argument("map", nargs="?", default=MAP, help="linker map (default: %(default)s)")
+    parser.add_argument("--top", type=int, default=30, help="functions to list")
+    args = parser.parse_args()
+
+    functions = load_functions(args.map)
+    dump = read_dump(args.source)
+    if dump.info is None:
+        print("no PC sampler dump found", file=sys.stderr)
+        return 1
+
+    info = dump.info
+    in_span = sum(dump.buckets.values())
+    print("%d samples at %d Hz (%.1f s), %d outside the histogram, %d inside interrupts%s" % (
+        info["samples"], info["rate_hz"], info["samples"] / float(info["rate_hz"] or 1),
+        info["outside"], info["in_handler"],
+        ", stopped on a full bucket" if info["stopped_full"] else ""))
+    if not in_span:
+        return 0
+
+    by_function, unknown = attribute(dump, functions)
+    by_object = defaultdict(float)
+    for (name, obj), count in by_function.items():
+        by_object[obj] += count
+
+    print("\n%8s %6s  %-40s %s" % ("samples", "%", "function", "object"))
+    ranked = sorted(by_function.items(), key=lambda item: -item[1])
+    for (name, obj), count in ranked[:args.top]:
+        print("%8.1f %6.2f  %-40s %s" % (count, 100.0 * count / in_span, name, obj))
+    if unknown >= 0.5:
+        print("%8.1f %6.2f  %-40s" % (unknown, 100.0 * unknown / in_span, "(no symbol)"))
+
+    print("\n%8s %6s  %s" % ("samples", "%", "object"))
+    for obj, count in sorted(by_object.items(), key=lambda item: -item[1]):
+        print("%8.1f %6.2f  %s" % (count, 100.0 * count / in_span, obj))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
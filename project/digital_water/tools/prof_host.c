@@ -0,0 +1,107 @@
+/* Run the stage profiler on the host.
+
+   Build and run from the project directory:
+
+     cc -O2 -DPROF_HOST -ICore/Inc -o prof_host tools/prof_host.c Core/Src/prof.c
+     ./prof_host [samples] [seed]
+
+   Each scope is fed a different made-up distribution of cycle counts through
+   prof_record() (steady, bimodal, long tailed, one huge outlier, enough
+   samples to halve the histogram), and its count, min, max, avg and p99 are
+   checked against the exact values from the sorted samples: p99 must not be
+   under the exact one nor more than one sub-bucket over it. Then one scope
+   is timed for real with PROF_BEGIN / PROF_END on the host clock, and the
+   table is dumped as prof_dump() prints it on the board. Exits 1 on a
+   mismatch.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prof.h"
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+static uint32_t sample(uint8_t scope, long i)
+{
+	switch (scope) {
+	case PROF_ACCEL_POLL:
+		return 150 + rnd(200); // straddles the bottom bucket
+	case PROF_SIM_PARTICLE_STEP:
+		return 180000 + rnd(5000);
+	case PROF_SIM_PUSH_APART:
+		return rnd(10) ? 400000 + rnd(20000) : 900000 + rnd(100000);
+	case PROF_SIM_TO_GRID:
+		return 100000 + rnd(1000) * rnd(1000) / 4; // long tail
+	case PROF_SIM_GRID_STEP:
+		return i == 17 ? 400000000u : 60000 + rnd(3000); // overflow bucket once
+	default:
+		return 1000 + rnd(1u << (8 + i % 12));
+	}
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static volatile uint32_t sink;
+
+int main(int argc, char **argv)
+{
+	long n = argc > 1 ? atol(argv[1]) : 200000; // > 65535 in one bucket halves it
+	seed = argc > 2 ? (uint32_t)atol(argv[2]) : 1;
+	uint32_t *samples = malloc(n * sizeof(*samples));
+	int errors = 0;
+
+	prof_init();
+	for (uint8_t scope = 0; scope < PROF_RENDER_IMAGE; scope++) {
+		uint64_t sum = 0;
+		for (long i = 0; i < n; i++) {
+			samples[i] = sample(scope, i);
+			sum += samples[i];
+			prof_record(scope, samples[i]);
+		}
+		qsort(samples, n, sizeof(*samples), cmp_u32);
+		// Smallest value with no more than 1% of the samples above it
+		uint32_t exact = samples[n - 1 - n / 100];
+		uint32_t p99 = prof_p99(scope);
+		const Prof_Scope_t *s = &prof_scopes[scope];
+		uint32_t slack = exact >> 2 > 256 ? exact >> 2 : 256;
+
+		if (s->count != (uint32_t)n || s->min != samples[0] || s->max != samples[n - 1] ||
+		    s->sum != sum) {
+			printf("scope %u: count/min/max/sum wrong\n", scope);
+			errors++;
+		}
+		if (p99 < exact || p99 - exact > slack) {
+			printf("scope %u: p99 %u, exact %u\n", scope, (unsigned)p99, (unsigned)exact);
+			errors++;
+		}
+	}
+
+	// Timed for real: a loop of growing length
+	for (int i = 0; i < 2000; i++) {
+		PROF_BEGIN(PROF_RENDER_IMAGE);
+		for (int k = 0; k < 1000 * (1 + i % 8); k++) sink += k;
+		PROF_END(PROF_RENDER_IMAGE);
+	}
+	if (prof_scopes[PROF_RENDER_IMAGE].count != 2000 ||
+	    prof_scopes[PROF_RENDER_IMAGE].max < prof_scopes[PROF_RENDER_IMAGE].min) {
+		printf("timed scope wrong\n");
+		errors++;
+	}
+
+	prof_dump();
+	printf("%s\n", errors ? "FAIL" : "ok");
+	free(samples);
+	return errors != 0;
+}
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""RAM use per module and per symbol from the linker map.
+
+Reads the RW_IRAM1 execution region of an armlink map (every section placed
+in RAM, with its size and object) and the symbol tables (to name what is
+inside each section), then prints the region total against its size, a table
+per module and the largest symbols. The stack and heap reserved by
+startup_stm32f446xx.s are listed as their own lines; how much of the stack
+is really used comes from the firmware (stack_high_water(), stack_paint.h).
+
+    python tools/ram_report.py [digital_water.map] [--top N]
+
+The project runs this after every build (Options for Target > User), so the
+numbers land in the build output next to the armlink summary.
+"""
+
+import argparse
+import os
+import re
+import sys
+from collections import defaultdict
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+MAP = os.path.join(HERE, "..", "MDK-ARM", "digital_water", "digital_water.map")
+REGION = "RW_IRAM1"
+
+# "    Execution Region RW_IRAM1 (Exec base: 0x20000000, ..., Size: 0x0001baf0, Max: 0x00020000, ABSOLUTE)"
+REGION_HEAD = re.compile(r"^\s+Execution Region (\S+) \(Exec base: 0x([0-9a-fA-F]+),.*"
+                         r"Size: 0x([0-9a-fA-F]+), Max: 0x([0-9a-fA-F]+)")
+# "    0x200000a8        -       0x0000d800   Zero   RW   143    .bss.grid_array     main.o"
+# "    0x2000000c   0x0800978c   0x00000004   PAD"
+SECTION = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+(?:0x[0-9a-fA-F]+|-)\s+0x([0-9a-fA-F]+)\s+"
+                     r"(Data|Zero|PAD)(?:\s+RW\s+\d+\s+(\S+)\s+(\S+))?")
+# "    grid_array    0x200000a8   Data   55296  main.o(.bss.grid_array)"
+SYMBOL = re.compile(r"^\s+(\S+)\s+0x([0-9a-fA-F]{8})\s+Data\s+(\d+)\s+(\S+?)\(")
+
+
+def read_map(path):
+    region = None
+    sections = []  # (addr, size, kind, section, object)
+    symbols = []   # (addr, size, name, object)
+    in_region = False
+    with open(path, errors="replace") as f:
+        for line in f:
+            head = REGION_HEAD.match(line)
+            if head:
+                in_region = head.group(1) == REGION
+                if in_region:
+                    region = (int(head.group(2), 16), int(head.group(3), 16), int(head.group(4), 16))
+                continue
+            if in_region:
+                m = SECTION.match(line)
+                if m:
+                    sections.append((int(m.group(1), 16), int(m.group(2), 16), m.group(3),
+                                     m.group(4) or "", m.group(5) or "(padding)"))
+                continue
+            m = SYMBOL.match(line)
+            if m and int(m.group(3)) > 0 and not m.group(1).startswith(".L"):
+                symbols.append((int(m.group(2), 16), int(m.group(3)), m.group(1), m.group(4)))
+    return region, sections, symbols
+
+
+def section_symbols(sections, symbols):
+    """Names each RAM section by the data symbols inside it, or by the
+    section itself (static data compiled into its own .bss.name section)."""
+    out = []
+    for addr, size, kind, section, obj in sections:
+        if kind == "PAD":
+            continue
+        member = re.sub(r"^.*\((.*)\)$", r"\1", obj)  # library(member.o)
+        inside = sorted({s for s in symbols if addr <= s[0] < addr + size and s[3] == member})
+        if inside and section not in ("HEAP", "STACK"):
+            out.extend((s_size, name, obj) for _, s_size, name, _ in inside)
+        else:
+            name = re.sub(r"^\.(bss|data)\.", "", section)
+            out.append((size, name, obj))
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("map", nargs="?", default=MAP)
+    parser.add_argument("--top", type=int, default=20, help="symbols to list")
+    args = parser.parse_args()
+
+    region, sections, symbols = read_map(args.map)
+    if region is None:
+        print("no %s region in %s" % (REGION, args.map), file=sys.stderr)
+        return 1
+    base, used, limit = region
+
+    reserved = {s[3]: s[1] for s in sections if s[3] in ("STACK", "HEAP")}
+    print("%s: %d of %d bytes (%.1f%%), %d free; stack %d, heap %d reserved" % (
+        REGION, used, limit, 100.0 * used / limit, limit - used,
+        reserved.get("STACK", 0), reserved.get("HEAP", 0)))
+    print()
+
+    modules = defaultdict(lambda: [0, 0])  # object -> [data, zero]
+    for addr, size, kind, section, obj in sections:
+        modules[obj][0 if kind == "Data" else 1] += size
+    print("%-34s %8s %8s %8s %6s" % ("module", "data", "zero", "total", "%"))
+    for obj, (data, zero) in sorted(modules.items(), key=lambda item: -sum(item[1])):
+        print("%-34s %8d %8d %8d %6.1f" % (obj, data, zero, data + zero, 100.0 * (data + zero) / limit))
+    print()
+
+    named = sorted(section_symbols(sections, symbols), key=lambda s: -s[0])
+    print("%-34s %8s  %s" % ("symbol", "bytes", "module"))
+    for size, name, obj in named[:args.top]:
+        print("%-34s %8d  %s" % (name, size, obj))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
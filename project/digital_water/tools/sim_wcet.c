@@ -0,0 +1,410 @@
+/* Search for the inputs that make a physics step or a frame render slowest.
+
+   Build and run on the host from the project directory:
+
+     cc -O2 -DPROF_HOST -Itools/host -ICore/Inc -o sim_wcet tools/sim_wcet.c \
+        Core/Src/fluid_sim.c Core/Src/physics.c Core/Src/water_palette.c Core/Src/prof.c -lm
+     ./sim_wcet [rounds] [seed] [dir]      search, saving the worst cases in dir
+     ./sim_wcet replay wcet_splat_corner.txt
+
+   A scenario is a starting position for every particle and a gravity vector
+   for each of SCENARIO_STEPS physics steps. Each one is run through
+   Sim_Physics_Step(), then renderImage() and renderBand() for every band,
+   as the tasks and the SPI1 interrupt do, once in each render mode
+   (SIM_RENDER_PARTICLES, _SURFACE and _SPLAT). Its costs are the slowest
+   step and the slowest render in each mode. Each step is timed as the
+   fastest of REPEATS runs, so host noise does not pass for a slow input.
+
+   The search starts from four families and hill-climbs each for `rounds`
+   mutations, separately for the physics cost and each mode's render cost:
+
+     flip    the default pool with gravity reversing every 1-4 steps
+     corner  every particle in one corner cell
+     wall    particles pinned against a wall by gravity into it
+     random  particles and gravity anywhere
+
+   Mutations re-aim gravity on some steps, or move a few particles onto one
+   cell or against a wall. The worst scenario of each family and cost is
+   written to dir as wcet_<cost>_<family>.txt (cost physics, particles,
+   surface or splat) with the measured figures in
+   its header. replay re-measures a saved file and prints the per-step times
+   and the stage table (prof_dump()), so an optimisation can be checked
+   against the same tail. Times are host microseconds: compare scenarios and
+   builds with them, not against the frame budget on the board.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fluid_sim.h"
+#include "oled.h"
+#include "prof.h"
+
+#define SCENARIO_STEPS 32 // about 2 s of physics
+#define REPEATS 3
+
+// What main.c and the drivers provide on the board
+Sim_Cell_t grid_array[SIM_PHYS_X_SIZE][SIM_PHYS_Y_SIZE];
+Sim_Particle_t particle_array[SIM_PARTICLE_COUNT];
+Sim_Particle_t obstacle_array[SIM_OBSTACLE_COUNT];
+Vec2_t GravityVector;
+uint8_t tx_buff[sizeof(PREAMBLE) + SIM_RENDER_X_SIZE * SIM_RENDER_Y_SIZE + sizeof(SUFFIX)];
+size_t tx_buff_len;
+int sim_time;
+UART_HandleTypeDef huart3;
+
+uint8_t oled_frame_busy(void) { return 0; }
+uint8_t usb_cdc_is_open(void) { return 0; }
+uint8_t usb_cdc_block_busy(void) { return 0; }
+uint8_t usb_cdc_send_block(const uint8_t *data, uint32_t len)
+{
+	(void)data;
+	(void)len;
+	return 1;
+}
+void dlog_flush(void) {}
+HAL_UART_StateTypeDef HAL_UART_GetState(UART_HandleTypeDef *huart)
+{
+	(void)huart;
+	return HAL_UART_STATE_READY;
+}
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size)
+{
+	(void)huart;
+	(void)pData;
+	(void)Size;
+	return HAL_OK;
+}
+
+// Render costs follow physics in SIM_RENDER_* order
+enum { COST_PHYSICS, COST_PARTICLES, COST_SURFACE, COST_SPLAT, COST_COUNT };
+static const char *const cost_names[COST_COUNT] = {"physics", "particles", "surface", "splat"};
+typedef char cost_mode_check[COST_PARTICLES + SIM_RENDER_SPLAT == COST_SPLAT ? 1 : -1];
+
+enum { FAMILY_FLIP, FAMILY_CORNER, FAMILY_WALL, FAMILY_RANDOM, FAMILY_COUNT };
+static const char *const family_names[FAMILY_COUNT] = {"flip", "corner", "wall", "random"};
+
+typedef struct
+{
+	uint8_t family;
+	Vec2_t start[SIM_PARTICLE_COUNT];
+	Vec2_t gravity[SCENARIO_STEPS];
+	// Measured
+	double us[COST_COUNT][SCENARIO_STEPS];
+	double worst[COST_COUNT];
+	int worst_step[COST_COUNT];
+	double mean[COST_COUNT];
+} Scenario_t;
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+static float rndf(float lo, float hi)
+{
+	return lo + (hi - lo) * (float)rnd(1 << 16) / (float)(1 << 16);
+}
+
+static double now_us(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+static Vec2_t gravity_at(float angle, float scale)
+{
+	return (Vec2_t){.x = cosf(angle) * SIM_GRAV * scale, .y = sinf(angle) * SIM_GRAV * scale};
+}
+
+static Vec2_t clamp_position(Vec2_t p)
+{
+	if (p.x < 0) p.x = 0;
+	if (p.x > SIM_PHYS_X_SIZE - 1) p.x = SIM_PHYS_X_SIZE - 1;
+	if (p.y < 0) p.y = 0;
+	if (p.y > SIM_PHYS_Y_SIZE - 1) p.y = SIM_PHYS_Y_SIZE - 1;
+	return p;
+}
+
+// Where a wall pin puts particle k: rows against wall 0-3 (left, right,
+// bottom, top), `depth` cells deep
+static Vec2_t wall_position(uint8_t wall, int k, int depth)
+{
+	int along = wall < 2 ? SIM_PHYS_Y_SIZE : SIM_PHYS_X_SIZE;
+	float a = (float)(k % along) + rndf(0, 0.5f);
+	float d = (float)(k / along % depth) * 0.5f + rndf(0, 0.25f);
+	switch (wall) {
+	case 0: return clamp_position((Vec2_t){.x = d, .y = a});
+	case 1: return clamp_position((Vec2_t){.x = SIM_PHYS_X_SIZE - 1 - d, .y = a});
+	case 2: return clamp_position((Vec2_t){.x = a, .y = d});
+	default: return clamp_position((Vec2_t){.x = a, .y = SIM_PHYS_Y_SIZE - 1 - d});
+	}
+}
+
+static const float wall_angle[4] = {(float)M_PI, 0, -(float)M_PI / 2, (float)M_PI / 2};
+
+static void generate(Scenario_t *s, uint8_t family)
+{
+	memset(s, 0, sizeof(*s));
+	s->family = family;
+
+	switch (family) {
+	case FAMILY_FLIP: {
+		Sim_Physics_Init();
+		for (int k = 0; k < SIM_PARTICLE_COUNT; k++) s->start[k] = particle_array[k].position;
+		float angle = rndf(0, 2 * (float)M_PI);
+		int period = 1 + rnd(4);
+		for (int i = 0; i < SCENARIO_STEPS; i++) {
+			if (i % period == 0) angle += (float)M_PI;
+			s->gravity[i] = gravity_at(angle, 1);
+		}
+		break;
+	}
+	case FAMILY_CORNER: {
+		float cx = rnd(2) ? SIM_PHYS_X_SIZE - 1.5f : 0.5f;
+		float cy = rnd(2) ? SIM_PHYS_Y_SIZE - 1.5f : 0.5f;
+		for (int k = 0; k < SIM_PARTICLE_COUNT; k++)
+			s->start[k] = clamp_position((Vec2_t){.x = cx + rndf(-0.5f, 0.5f), .y = cy + rndf(-0.5f, 0.5f)});
+		float angle = rndf(0, 2 * (float)M_PI);
+		for (int i = 0; i < SCENARIO_STEPS; i++) s->gravity[i] = gravity_at(angle, 1);
+		break;
+	}
+	case FAMILY_WALL: {
+		uint8_t wall = rnd(4);
+		int depth = 1 + rnd(3);
+		for (int k = 0; k < SIM_PARTICLE_COUNT; k++) s->start[k] = wall_position(wall, k, depth);
+		for (int i = 0; i < SCENARIO_STEPS; i++) s->gravity[i] = gravity_at(wall_angle[wall], 1);
+		break;
+	}
+	default:
+		for (int k = 0; k < SIM_PARTICLE_COUNT; k++)
+			s->start[k] = (Vec2_t){.x = rndf(0, SIM_PHYS_X_SIZE - 1), .y = rndf(0, SIM_PHYS_Y_SIZE - 1)};
+		for (int i = 0; i < SCENARIO_STEPS; i++) s->gravity[i] = gravity_at(rndf(0, 2 * (float)M_PI), rndf(0, 1));
+		break;
+	}
+}
+
+static void mutate(Scenario_t *s)
+{
+	switch (rnd(4)) {
+	case 0: { // re-aim gravity over a run of steps
+		int from = rnd(SCENARIO_STEPS), len = 1 + rnd(4);
+		Vec2_t g = gravity_at(rndf(0, 2 * (float)M_PI), rndf(0.5f, 1));
+		for (int i = from; i < from + len && i < SCENARIO_STEPS; i++) s->gravity[i] = g;
+		break;
+	}
+	case 1: { // reverse gravity from some step on
+		for (int i = rnd(SCENARIO_STEPS); i < SCENARIO_STEPS; i++) {
+			s->gravity[i].x = -s->gravity[i].x;
+			s->gravity[i].y = -s->gravity[i].y;
+		}
+		break;
+	}
+	case 2: { // crowd a few percent of the particles into one cell
+		Vec2_t c = {.x = rndf(0, SIM_PHYS_X_SIZE - 1), .y = rndf(0, SIM_PHYS_Y_SIZE - 1)};
+		int n = 1 + rnd(SIM_PARTICLE_COUNT / 20);
+		for (int j = 0; j < n; j++) {
+			int k = rnd(SIM_PARTICLE_COUNT);
+			s->start[k] = clamp_position((Vec2_t){.x = c.x + rndf(-0.5f, 0.5f), .y = c.y + rndf(-0.5f, 0.5f)});
+		}
+		break;
+	}
+	default: { // pin a few percent against a wall
+		uint8_t wall = rnd(4);
+		int n = 1 + rnd(SIM_PARTICLE_COUNT / 20);
+		for (int j = 0; j < n; j++) {
+			int k = rnd(SIM_PARTICLE_COUNT);
+			s->start[k] = wall_position(wall, k, 1);
+		}
+		break;
+	}
+	}
+}
+
+static void load(const Scenario_t *s)
+{
+	Sim_Physics_Init();
+	for (int k = 0; k < SIM_PARTICLE_COUNT; k++) {
+		particle_array[k].position = s->start[k];
+		particle_array[k].velocity = BlankVector_V2();
+	}
+	sim_render_alpha = 1;
+}
+
+static void measure(Scenario_t *s)
+{
+	static uint16_t band[OLED_BAND_PIXELS];
+
+	for (int c = 0; c < COST_COUNT; c++)
+		for (int i = 0; i < SCENARIO_STEPS; i++) s->us[c][i] = INFINITY;
+	for (int r = 0; r < REPEATS; r++) {
+		load(s);
+		for (int i = 0; i < SCENARIO_STEPS; i++) {
+			GravityVector = s->gravity[i];
+			double t0 = now_us();
+			Sim_Physics_Step();
+			double t1 = now_us();
+			if (t1 - t0 < s->us[COST_PHYSICS][i]) s->us[COST_PHYSICS][i] = t1 - t0;
+
+			// Every mode renders the same state
+			for (uint8_t mode = SIM_RENDER_PARTICLES; mode <= SIM_RENDER_SPLAT; mode++) {
+				double *us = &s->us[COST_PARTICLES + mode][i];
+				sim_render_mode = mode;
+				t0 = now_us();
+				renderImage();
+				for (uint8_t b = 0; b < OLED_BAND_COUNT; b++) renderBand(b, band);
+				t1 = now_us();
+				if (t1 - t0 < *us) *us = t1 - t0;
+			}
+		}
+	}
+	sim_render_mode = SIM_RENDER_MODE_DEFAULT;
+
+	for (int c = 0; c < COST_COUNT; c++) {
+		const double *us = s->us[c];
+		s->worst[c] = 0;
+		s->mean[c] = 0;
+		for (int i = 0; i < SCENARIO_STEPS; i++) {
+			s->mean[c] += us[i] / SCENARIO_STEPS;
+			if (us[i] > s->worst[c]) {
+				s->worst[c] = us[i];
+				s->worst_step[c] = i;
+			}
+		}
+	}
+}
+
+static int save(const Scenario_t *s, int cost, const char *path)
+{
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		perror(path);
+		return 0;
+	}
+	fprintf(f, "# sim_wcet scenario, host microseconds, fastest of %d runs\n", REPEATS);
+	fprintf(f, "# worst %s %.1f us at step %d, mean %.1f us\n", cost_names[cost], s->worst[cost],
+	        s->worst_step[cost], s->mean[cost]);
+	fprintf(f, "family %s\n", family_names[s->family]);
+	fprintf(f, "steps %d\n", SCENARIO_STEPS);
+	for (int i = 0; i < SCENARIO_STEPS; i++) fprintf(f, "g %.6f %.6f\n", s->gravity[i].x, s->gravity[i].y);
+	fprintf(f, "particles %d\n", SIM_PARTICLE_COUNT);
+	for (int k = 0; k < SIM_PARTICLE_COUNT; k++) fprintf(f, "p %.6f %.6f\n", s->start[k].x, s->start[k].y);
+	fclose(f);
+	return 1;
+}
+
+static int load_file(Scenario_t *s, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[128], name[32];
+	int steps = 0, particles = 0;
+
+	if (!f) {
+		perror(path);
+		return 0;
+	}
+	memset(s, 0, sizeof(*s));
+	while (fgets(line, sizeof(line), f)) {
+		float x, y;
+		if (sscanf(line, "family %31s", name) == 1) {
+			for (uint8_t i = 0; i < FAMILY_COUNT; i++)
+				if (strcmp(name, family_names[i]) == 0) s->family = i;
+		} else if (sscanf(line, "g %f %f", &x, &y) == 2 && steps < SCENARIO_STEPS) {
+			s->gravity[steps++] = (Vec2_t){.x = x, .y = y};
+		} else if (sscanf(line, "p %f %f", &x, &y) == 2 && particles < SIM_PARTICLE_COUNT) {
+			s->start[particles++] = (Vec2_t){.x = x, .y = y};
+		}
+	}
+	fclose(f);
+	if (steps != SCENARIO_STEPS || particles != SIM_PARTICLE_COUNT) {
+		fprintf(stderr, "%s: %d steps and %d particles, this build wants %d and %d\n", path, steps, particles,
+		        SCENARIO_STEPS, SIM_PARTICLE_COUNT);
+		return 0;
+	}
+	return 1;
+}
+
+static int replay(const char *path)
+{
+	static Scenario_t s;
+
+	if (!load_file(&s, path)) return 1;
+	measure(&s);
+	printf("step  (us)");
+	for (int c = 0; c < COST_COUNT; c++) printf(" %10s", cost_names[c]);
+	printf("\n");
+	for (int i = 0; i < SCENARIO_STEPS; i++) {
+		printf("%10d", i);
+		for (int c = 0; c < COST_COUNT; c++) printf(" %10.1f", s.us[c][i]);
+		printf("\n");
+	}
+	for (int c = 0; c < COST_COUNT; c++)
+		printf("%s: worst %.1f us at step %d, mean %.1f us\n", cost_names[c], s.worst[c], s.worst_step[c],
+		       s.mean[c]);
+
+	// Stage split of one more run
+	prof_reset();
+	load(&s);
+	for (int i = 0; i < SCENARIO_STEPS; i++) {
+		GravityVector = s.gravity[i];
+		Sim_Physics_Step();
+	}
+	printf("\n");
+	prof_dump();
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static Scenario_t best[COST_COUNT][FAMILY_COUNT], candidate, baseline;
+	int rounds = 200;
+	const char *dir = ".";
+
+	if (argc == 3 && strcmp(argv[1], "replay") == 0) return replay(argv[2]);
+	if (argc > 1) rounds = atoi(argv[1]);
+	if (argc > 2) seed = strtoul(argv[2], NULL, 0);
+	if (argc > 3) dir = argv[3];
+
+	// The pool settling under steady gravity, for scale
+	Sim_Physics_Init();
+	for (int k = 0; k < SIM_PARTICLE_COUNT; k++) baseline.start[k] = particle_array[k].position;
+	for (int i = 0; i < SCENARIO_STEPS; i++) baseline.gravity[i] = GravityVector;
+	measure(&baseline);
+	for (int c = 0; c < COST_COUNT; c++)
+		printf("baseline %-9s worst %8.1f us, mean %8.1f us\n", cost_names[c], baseline.worst[c],
+		       baseline.mean[c]);
+
+	for (uint8_t family = 0; family < FAMILY_COUNT; family++) {
+		for (int c = 0; c < COST_COUNT; c++) {
+			Scenario_t *b = &best[c][family];
+			generate(b, family);
+			measure(b);
+			for (int r = 0; r < rounds; r++) {
+				// Mostly climb from the best so far, sometimes restart
+				if (rnd(8) == 0) {
+					generate(&candidate, family);
+				} else {
+					candidate = *b;
+					for (int m = 1 + rnd(3); m > 0; m--) mutate(&candidate);
+				}
+				measure(&candidate);
+				if (candidate.worst[c] > b->worst[c]) *b = candidate;
+			}
+
+			char path[512];
+			snprintf(path, sizeof(path), "%s/wcet_%s_%s.txt", dir, cost_names[c], family_names[family]);
+			printf("%-9s %-7s worst %8.1f us (x%.2f baseline) at step %2d, mean %8.1f us -> %s\n",
+			       cost_names[c], family_names[family], b->worst[c], b->worst[c] / baseline.worst[c],
+			       b->worst_step[c], b->mean[c], path);
+			if (!save(b, c, path)) return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Decode binary telemetry from USART3 into CSV.
+
+Packet layout (Core/Inc/telemetry.h):
+
+    0x5A 0xA5, type, length, payload, CRC-16/CCITT-FALSE (LE) over type..payload
+
+The stream is shared with the deferred log (tools/dlog_decode.py); anything
+that is not a packet with a valid CRC is skipped.
+
+    python tools/telem_decode.py COM5 > frames.csv          # live, needs pyserial
+    python tools/telem_decode.py capture.bin > frames.csv
+"""
+
+import os
+import struct
+import sys
+
+TELEM_SYNC = b"\x5a\xa5"
+TELEM_TYPE_FRAME = 0x01
+BAUD = 115200
+
+STAGES = ["accel", "physics", "render", "display"]
+
+# Telem_Frame_t
+FRAME_FORMAT = "<II%dIIIffffHHHHHH" % len(STAGES)
+FRAME_FIELDS = (["frame", "tick_ms"] + ["%s_cycles" % s for s in STAGES] +
+                ["frame_cycles", "oled_bytes", "gravity_x", "gravity_y",
+                 "mean_speed", "max_speed", "accel_samples", "physics_steps",
+                 "ticks_late", "ticks_dropped", "gov_level", "frames_skipped"])
+
+
+def crc16(data, crc=0xFFFF):
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def packet_at(buf, pos=0):
+    """Returns (type, payload, size) for a valid packet at buf[pos], None if
+    there is none, or "short" if one may start there but is incomplete."""
+    if buf[pos:pos + 2] != TELEM_SYNC[:len(buf) - pos]:
+        return None
+    if len(buf) - pos < 4:
+        return "short"
+    kind, length = buf[pos + 2], buf[pos + 3]
+    size = 6 + length
+    if len(buf) - pos < size:
+        return "short"
+    crc = struct.unpack_from("<H", buf, pos + 4 + length)[0]
+    if crc16(buf[pos + 2:pos + 4 + length]) != crc:
+        return None
+    return kind, bytes(buf[pos + 4:pos + 4 + length]), size
+
+
+class Decoder:
+    def __init__(self, out):
+        self.buf = bytearray()
+        self.out = out
+        self.out.write(",".join(FRAME_FIELDS) + "\n")
+
+    def feed(self, data):
+        self.buf += data
+        pos = 0
+        while pos < len(self.buf):
+            found = packet_at(self.buf, pos)
+            if found == "short":
+                break
+            if found is None:
+                pos += 1
+                continue
+            kind, payload, size = found
+            pos += size
+            if kind == TELEM_TYPE_FRAME and len(payload) == struct.calcsize(FRAME_FORMAT):
+                values = struct.unpack(FRAME_FORMAT, payload)
+                self.out.write(",".join(
+                    "%.4f" % v if isinstance(v, float) else str(v) for v in values) + "\n")
+        del self.buf[:pos]
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__)
+        return 1
+    decoder = Decoder(sys.stdout)
+    source = sys.argv[1]
+
+    if os.path.exists(source):
+        with open(source, "rb") as f:
+            decoder.feed(f.read())
+        return 0
+
+    import serial  # pyserial, only for live capture
+    with serial.Serial(source, BAUD, timeout=0.1) as port:
+        while True:
+            decoder.feed(port.read(4096))
+            sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+"""Turn a trace dump into Chrome trace-event JSON.
+
+trace_dump() (Core/Inc/trace.h) sends a TELEM_TYPE_TRACE_INFO packet and then
+the ring, oldest first, as TELEM_TYPE_TRACE packets. Event names and tracks
+come from Core/Inc/trace_events.h, so run this against the same tree the
+firmware was built from. Open the output in chrome://tracing or
+https://ui.perfetto.dev: the main loop and the interrupt handlers get a row
+each, so overlap, idle time (the scheduler in WFI) and how long an interrupt
+waited behind another are visible on one timeline.
+
+    python tools/trace_to_chrome.py capture.bin > trace.json
+    python tools/trace_to_chrome.py COM5 > trace.json       # live, needs pyserial
+
+The most recent dump in the capture is used. A summary per event goes to
+stderr.
+"""
+
+import json
+import os
+import re
+import struct
+import sys
+from collections import defaultdict
+
+from telem_decode import BAUD, packet_at
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+EVENTS = os.path.join(HERE, "..", "Core", "Inc", "trace_events.h")
+
+TELEM_TYPE_TRACE_INFO = 0x04
+TELEM_TYPE_TRACE = 0x05
+INFO_FORMAT = "<IIHH"   # Trace_Info_t
+RECORD_FORMAT = "<IBBH"  # Trace_Record_t
+PH_BEGIN, PH_END, PH_MARK = 0, 1, 2
+TRACKS = {"MAIN": 1, "IRQ": 2}
+
+
+def load_events(path=EVENTS):
+    events = []
+    with open(path) as f:
+        for line in f:
+            m = re.match(r'\s*TRACE_EVENT\(\s*(\w+)\s*,\s*(\w+)\s*,\s*"(.*)"\s*\)', line)
+            if m:
+                events.append((m.group(3), TRACKS[m.group(2)]))
+    return events
+
+
+class Dump:
+    def __init__(self):
+        self.info = None
+        self.records = []
+
+    def packet(self, kind, payload):
+        if kind == TELEM_TYPE_TRACE_INFO and len(payload) == struct.calcsize(INFO_FORMAT):
+            # A new dump starts: forget the previous one
+            self.info = dict(zip(["core_hz", "written", "records"],
+                                 struct.unpack(INFO_FORMAT, payload)[:3]))
+            self.records = []
+        elif kind == TELEM_TYPE_TRACE and self.info is not None:
+            self.records.extend(struct.iter_unpack(RECORD_FORMAT, payload))
+
+    def complete(self):
+        if self.info is None:
+            return False
+        return len(self.records) >= min(self.info["written"], self.info["records"])
+
+
+def read_dump(source):
+    dump = Dump()
+    buf = bytearray()
+
+    def feed(data):
+        buf.extend(data)
+        pos = 0
+        while pos < len(buf):
+            found = packet_at(buf, pos)
+            if found == "short":
+                break
+            if found is None:
+                pos += 1
+                continue
+            kind, payload, size = found
+            dump.packet(kind, payload)
+            pos += size
+        del buf[:pos]
+
+    if os.path.exists(source):
+        with open(source, "rb") as f:
+            feed(f.read())
+        return dump
+
+    import serial  # pyserial, only for live capture
+    print("waiting for a dump (press the button)...", file=sys.stderr)
+    with serial.Serial(source, BAUD, timeout=1) as port:
+        while not dump.complete():
+            feed(port.read(4096))
+    return dump
+
+
+def unwrap(records):
+    """Extends the 32-bit cycle counts, which wrap every ~25 s at 168 MHz.
+    Records are in ring order, which is time order but for writers preempted
+    between their timestamp and their slot, so only small steps back occur."""
+    out = []
+    high = 0
+    last = None
+    for cycles, event, phase, arg in records:
+        if last is not None and cycles < last and last - cycles > 1 << 31:
+            high += 1 << 32
+        elif last is not None and cycles > last and cycles - last > 1 << 31:
+            high -= 1 << 32  # a late record from before the wrap
+        last = cycles
+        out.append((high + cycles, event, phase, arg))
+    out.sort(key=lambda r: r[0])
+    return out
+
+
+def convert(dump, events):
+    hz = dump.info["core_hz"]
+    records = unwrap(dump.records)
+    t0 = records[0][0] if records else 0
+    trace = []
+    open_spans = defaultdict(list)  # event -> begin timestamps
+    stats = defaultdict(lambda: [0, 0.0, 0.0])  # count, total us, max us
+
+    def name_of(event):
+        return events[event] if event < len(events) else ("event %d" % event, TRACKS["MAIN"])
+
+    for cycles, event, phase, arg in records:
+        ts = (cycles - t0) * 1e6 / hz
+        name, tid = name_of(event)
+        if phase == PH_BEGIN:
+            open_spans[event].append(ts)
+            trace.append({"name": name, "ph": "B", "ts": ts, "pid": 1, "tid": tid,
+                          "args": {"arg": arg}})
+        elif phase == PH_END:
+            # The matching begin may have been overwritten
+            if not open_spans[event]:
+                continue
+            begin = open_spans[event].pop()
+            trace.append({"name": name, "ph": "E", "ts": ts, "pid": 1, "tid": tid,
+                          "args": {"arg": arg}})
+            s = stats[name]
+            s[0] += 1
+            s[1] += ts - begin
+            s[2] = max(s[2], ts - begin)
+        else:
+            trace.append({"name": name, "ph": "i", "s": "t", "ts": ts, "pid": 1, "tid": tid,
+                          "args": {"arg": arg}})
+
+    # Spans still open when the dump was taken end with it
+    end = (records[-1][0] - t0) * 1e6 / hz if records else 0
+    for event, begins in open_spans.items():
+        name, tid = name_of(event)
+        for _ in begins:
+            trace.append({"name": name, "ph": "E", "ts": end, "pid": 1, "tid": tid})
+
+    trace.append({"name": "thread_name", "ph": "M", "pid": 1, "tid": TRACKS["MAIN"],
+                  "args": {"name": "main loop"}})
+    trace.append({"name": "thread_name", "ph": "M", "pid": 1, "tid": TRACKS["IRQ"],
+                  "args": {"name": "interrupts"}})
+    return {"traceEvents": trace, "displayTimeUnit": "ms"}, stats, end
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__)
+        return 1
+    dump = read_dump(sys.argv[1])
+    if dump.info is None:
+        print("no trace dump found", file=sys.stderr)
+        return 1
+
+    result, stats, span_us = convert(dump, load_events())
+    json.dump(result, sys.stdout)
+    sys.stdout.write("\n")
+
+    info = dump.info
+    print("%d records over %.1f ms (%d written, ring of %d)" % (
+        len(dump.records), span_us / 1000, info["written"], info["records"]), file=sys.stderr)
+    print("%-28s %6s %10s %10s %10s" % ("event", "count", "total us", "mean us", "max us"),
+          file=sys.stderr)
+    for name, (count, total, longest) in sorted(stats.items(), key=lambda item: -item[1][1]):
+        print("%-28s %6d %10.1f %10.1f %10.1f" % (name, count, total, total / count, longest),
+              file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,235 @@
+/* Exercise the USB CDC streaming logic against a stand-in PCD layer.
+
+   Build and run on the host from the project directory:
+
+     cc -O2 -DUSB_CDC_HOST -ICore/Inc -o usb_cdc_sim tools/usb_cdc_sim.c Core/Src/usb_cdc_tx.c
+     ./usb_cdc_sim [steps] [seed]
+
+   The stand-in takes the place of HAL_PCD_EP_Transmit: it holds one bulk IN
+   transfer at a time, and the simulated host drains it as 64 byte packets
+   whenever it polls. The main loop side writes telemetry-sized records and
+   frame-sized blocks, each tagged with a sequence number and a checksum, while
+   the host stalls, closes and reopens the port and resets the bus at random.
+
+   At the end the host stream is parsed back. It fails (exit 1) if a record
+   or block arrived corrupted or out of order, if the firmware touched a block
+   before the endpoint was done with it, if a transfer was started while
+   another was in flight, or if the stream went idle on a full packet (the
+   host read would never complete).
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "usb_cdc_tx.h"
+
+#define BLOCK_MAX 6200
+#define STREAM_MAX (64 * 1024 * 1024)
+
+// Stand-in endpoint
+static const uint8_t *ep_data;
+static uint8_t ep_copy[BLOCK_MAX];
+static uint32_t ep_len;
+static int ep_busy;
+static int errors;
+
+// Host side
+static uint8_t *stream;
+static size_t stream_len;
+static int last_packet_full;
+static long hung_reads;
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % n;
+}
+
+uint8_t usb_cdc_ep_transmit(const uint8_t *data, uint32_t len)
+{
+	if (ep_busy) {
+		printf("transmit while a transfer is in flight\n");
+		errors++;
+	}
+	if (len > sizeof(ep_copy)) {
+		printf("transfer of %u bytes\n", (unsigned)len);
+		errors++;
+		len = sizeof(ep_copy);
+	}
+	ep_data = data;
+	ep_len = len;
+	if (len) memcpy(ep_copy, data, len);
+	ep_busy = 1;
+	return 0;
+}
+
+// The host polls the endpoint until the transfer is done
+static void host_read(void)
+{
+	if (!ep_busy) return;
+	if (ep_len && memcmp(ep_copy, ep_data, ep_len)) {
+		printf("buffer changed while on the wire\n");
+		errors++;
+	}
+	if (stream_len + ep_len > STREAM_MAX) {
+		printf("stream full\n");
+		exit(1);
+	}
+	memcpy(stream + stream_len, ep_copy, ep_len);
+	stream_len += ep_len;
+	last_packet_full = ep_len && ep_len % USB_CDC_MAX_PACKET == 0;
+	ep_busy = 0;
+	usb_cdc_tx_done();
+	// Nothing more coming: the host read is stuck unless the last packet was short
+	if (!ep_busy && last_packet_full) hung_reads++;
+}
+
+// Record: 'R', seq (4), len (1), payload, sum (1). Block: 'B', seq (4), len (2), payload, sum (1).
+static uint32_t record_seq, block_seq;
+static long records_sent, records_refused, blocks_sent, blocks_refused;
+static uint8_t block_buf[BLOCK_MAX];
+static int block_owned;
+
+static uint8_t checksum(const uint8_t *p, size_t n)
+{
+	uint8_t sum = 0;
+	while (n--) sum = (uint8_t)(sum * 31 + *p++);
+	return sum;
+}
+
+static void main_write_record(void)
+{
+	uint8_t rec[6 + 255 + 1];
+	uint8_t len = (uint8_t)(1 + rnd(250));
+
+	rec[0] = 'R';
+	memcpy(&rec[1], &record_seq, 4);
+	rec[5] = len;
+	for (int i = 0; i < len; i++) rec[6 + i] = (uint8_t)rnd(256);
+	rec[6 + len] = checksum(rec, 6 + len);
+	if (usb_cdc_write(rec, (uint16_t)(7 + len))) records_sent++;
+	else records_refused++;
+	record_seq++;
+}
+
+static void main_send_block(void)
+{
+	if (block_owned && usb_cdc_block_busy()) {
+		blocks_refused++; // frame skipped, as streamFrame() does
+		return;
+	}
+	block_owned = 0;
+
+	// Scribble over the old contents first: they must be off the wire by now
+	memset(block_buf, 0xEE, sizeof(block_buf));
+	uint16_t len = rnd(4) ? (uint16_t)(64 + rnd(BLOCK_MAX - 72)) : (uint16_t)(64 * (1 + rnd(90)));
+	uint16_t payload = len - 8;
+	block_buf[0] = 'B';
+	memcpy(&block_buf[1], &block_seq, 4);
+	memcpy(&block_buf[5], &payload, 2);
+	for (int i = 0; i < payload; i++) block_buf[7 + i] = (uint8_t)(block_seq + i * 7);
+	block_buf[7 + payload] = checksum(block_buf, 7 + payload);
+	if (usb_cdc_send_block(block_buf, len)) {
+		blocks_sent++;
+		block_owned = 1;
+	} else {
+		blocks_refused++;
+	}
+	block_seq++;
+}
+
+static int parse_stream(long *records, long *blocks)
+{
+	size_t pos = 0;
+	long last_record = -1, last_block = -1;
+
+	*records = *blocks = 0;
+	while (pos < stream_len) {
+		uint32_t seq;
+		size_t size;
+		if (stream[pos] == 'R' && pos + 6 <= stream_len) {
+			size = 7 + stream[pos + 5];
+		} else if (stream[pos] == 'B' && pos + 7 <= stream_len) {
+			uint16_t payload;
+			memcpy(&payload, &stream[pos + 5], 2);
+			size = 8 + payload;
+		} else {
+			printf("garbage at %zu\n", pos);
+			return 1;
+		}
+		if (pos + size > stream_len || checksum(&stream[pos], size - 1) != stream[pos + size - 1]) {
+			printf("corrupt %c at %zu\n", stream[pos], pos);
+			return 1;
+		}
+		memcpy(&seq, &stream[pos + 1], 4);
+		long *last = stream[pos] == 'R' ? &last_record : &last_block;
+		if ((long)seq <= *last) {
+			printf("%c %u after %ld\n", stream[pos], (unsigned)seq, *last);
+			return 1;
+		}
+		*last = seq;
+		if (stream[pos] == 'R') (*records)++;
+		else (*blocks)++;
+		pos += size;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	long steps = argc > 1 ? atol(argv[1]) : 200000;
+	seed = argc > 2 ? (uint32_t)atol(argv[2]) : 1;
+	int open = 1, stalled = 0;
+	long resets = 0, closes = 0;
+
+	stream = malloc(STREAM_MAX);
+	usb_cdc_tx_reset();
+	usb_cdc_tx_open(1);
+
+	for (long step = 0; step < steps; step++) {
+		uint32_t event = rnd(1000);
+
+		if (event < 300) {
+			main_write_record();
+		} else if (event < 400) {
+			main_send_block();
+		} else if (event < 900) {
+			if (open && !stalled) host_read();
+		} else if (event < 960) {
+			stalled = !stalled; // host stops reading for a while
+		} else if (event < 995) {
+			if (open) closes++;
+			open = !open;
+			usb_cdc_tx_open((uint8_t)open);
+		} else {
+			// Bus reset: the transfer on the wire is lost with the endpoint
+			ep_busy = 0;
+			usb_cdc_tx_reset();
+			resets++;
+			open = 1;
+			usb_cdc_tx_open(1);
+		}
+	}
+	// Reopen and drain whatever is still queued
+	if (!open) usb_cdc_tx_open(1);
+	while (ep_busy) host_read();
+
+	long records, blocks;
+	errors += parse_stream(&records, &blocks);
+	if (hung_reads) {
+		printf("%ld reads left waiting after a full packet\n", hung_reads);
+		errors++;
+	}
+
+	printf("%ld steps, %zu bytes received, %ld closes, %ld resets\n", steps, stream_len, closes, resets);
+	printf("records: %ld queued, %ld received, %ld refused, %u dropped full\n",
+	       records_sent, records, records_refused, (unsigned)usb_cdc_tx_dropped);
+	printf("blocks: %ld queued, %ld received, %ld skipped busy or closed\n",
+	       blocks_sent, blocks, blocks_refused);
+	printf("%s\n", errors ? "FAIL" : "ok");
+	return errors != 0;
+}